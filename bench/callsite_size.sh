@@ -0,0 +1,40 @@
+#!/bin/sh
+# Author: Arman Sahakyan
+# Code size of LOG_MSG call sites: generates a TU of N functions, each doing
+#   if (a > i) LOG_MSG << "site i" << int << double << std::string;
+# and prints the .text* section sizes of its object file, compiled against
+# utils_log/log.hpp (UTILS_LOG_COMPILED_LIB) and header-only.
+# Run from the repository root: bench/callsite_size.sh [N] [compiler]
+set -e
+N=${1:-200}
+CXX=${2:-c++}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+{
+  echo '#include <string>'
+  echo '#ifdef UTILS_LOG_COMPILED_LIB'
+  echo '#include "utils_log/log.hpp"'
+  echo '#else'
+  echo '#include "utils_log/logger.hpp"'
+  echo '#endif'
+  i=0
+  while [ "$i" -lt "$N" ]; do
+    echo "void f$i(int a, double d, const std::string &s) { if (a > $i) LOG_MSG << \"site $i\" << a << d << s; }"
+    i=$((i + 1))
+  done
+} > "$TMP/sites.cpp"
+
+report() {
+  size -A "$1" | awk -v n="$N" -v mode="$2" '
+    $1 == ".text" { text = $2 }
+    $1 == ".text.unlikely" { unlikely = $2 }
+    $1 ~ /^\.text/ { all += $2 }
+    END { printf "%-12s .text %6d  .text.unlikely %6d  all .text* %6d (%d B/site)\n", mode, text, unlikely, all, all / n }'
+}
+
+"$CXX" -std=c++17 -O2 -DUTILS_LOG_COMPILED_LIB -I"$ROOT" -c "$TMP/sites.cpp" -o "$TMP/compiled.o"
+report "$TMP/compiled.o" compiled
+"$CXX" -std=c++17 -O2 -I"$ROOT" -c "$TMP/sites.cpp" -o "$TMP/header.o"
+report "$TMP/header.o" header-only
@@ -0,0 +1,69 @@
+// Author: Arman Sahakyan
+// Round trip: a TokenBloom has no false negatives, in memory and after
+// save/load, and a whole-word searchLogs() finds every token of a segment
+// whose sidecar the logger wrote.
+// Build: c++ -std=c++17 -O2 -I.. bloom_test.cpp -o bloom_test (tests/run.sh runs all)
+#include "utils_log/logger.hpp"
+#include "utils_log/bloom.hpp"
+#include "utils_log/mapped_file.hpp"
+#include "utils_log/search.hpp"
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+int main() {
+  using utils_log::impl::TokenBloom;
+
+  // deliberately small: many bits collide, none may be missed
+  std::vector<std::string> tokens;
+  for (int i = 0; i < 5000; ++i) tokens.push_back("tok-" + std::to_string(i * 7919));
+  TokenBloom bloom;
+  bloom.reset(8192, 4);
+  for (const auto &t : tokens) bloom.add(t);
+  for (const auto &t : tokens) assert(bloom.mayContain(t));
+
+  std::string text;
+  for (const auto &t : tokens) text += t + ", ";
+  TokenBloom fromText;
+  fromText.reset(1 << 16, 4);
+  fromText.addTokens(text);
+  size_t falsePositives = 0;
+  for (int i = 0; i < 5000; ++i) {
+    assert(fromText.mayContain(tokens[static_cast<size_t>(i)]));
+    falsePositives += fromText.mayContain("absent-" + std::to_string(i));
+  }
+  assert(falsePositives < 2500);
+  assert(!fromText.mayContain("abc")); // shorter than minToken: never added
+
+  assert(fromText.save("unit.bloom", 12345));
+  utils_log::impl::MappedFile image("unit.bloom");
+  TokenBloom loaded;
+  assert(!loaded.load(image.view(), 12346)); // covers another segment size
+  assert(loaded.load(image.view(), 12345));
+  for (const auto &t : tokens) assert(loaded.mayContain(t));
+
+  // through the logger and the search
+  SET_LOG_OUTPUT_FILE_PATH("bloom.log");
+  SET_LOG_TO_CONSOLE(false);
+  SET_LOG_BLOOM_FILTER(1 << 16);
+  for (int i = 0; i < 2000; ++i) LOG_INFO << "request req-" + std::to_string(i) + " done";
+  utils_log::Log::terminate(); // saves the sidecar
+
+  const auto segments = utils_log::logSegments("bloom.log");
+  for (int i = 0; i < 2000; i += 37) {
+    utils_log::SearchQuery q;
+    q.text = "req-" + std::to_string(i);
+    q.wholeWord = true;
+    q.threads = 1;
+    const auto r = utils_log::searchLogs(segments, q);
+    assert(r.errors.empty() && r.skipped == 0 && r.hits.size() == 1);
+  }
+  utils_log::SearchQuery absent;
+  absent.text = "req-zzzz-never-logged";
+  absent.wholeWord = true;
+  absent.threads = 1;
+  const auto none = utils_log::searchLogs(segments, absent);
+  assert(none.hits.empty() && none.skipped == 1); // the sidecar is in use
+  return 0;
+}
@@ -0,0 +1,80 @@
+// Author: Arman Sahakyan
+// The log budget's state machine, driven with synthetic window times: over
+// budget raises the level one step per window up to WARN, three quiet windows
+// (or an idle stretch as long) lower it one step, and in between nothing moves.
+// Build: c++ -std=c++17 -O2 -I.. budget_test.cpp -o budget_test (tests/run.sh runs all)
+#include "utils_log/logger.hpp"
+
+#include <cassert>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using utils_log::Level;
+
+static constexpr int64_t second = 1000000000;
+// ahead of the real clock, so the WARN records' own commits never end a window
+static int64_t now = utils_log::impl::steadyNs() + 1000 * second;
+
+// Ends a window of `seconds` in which `bytes` were written; the level after it.
+static Level window(uint64_t bytes, int64_t seconds = 1) {
+  auto &b = utils_log::impl::logBudget();
+  b.costNs = 0;
+  b.bytes = bytes;
+  utils_log::impl::checkLogBudget(now += seconds * second);
+  return static_cast<Level>(utils_log::impl::throttleLevel.load());
+}
+
+int main() {
+  SET_LOG_OUTPUT_FILE_PATH("budget.log");
+  SET_LOG_TO_CONSOLE(false);
+  SET_LOG_LEVEL(Level::Debug);
+  SET_LOG_BUDGET(0, 1000); // bytes per second only: commit time is real time
+  utils_log::impl::checkLogBudget(now); // opens the first window
+
+  // raised one step per window over budget, never above WARN
+  assert(window(5000) == Level::Info);
+  assert(!utils_log::isEnabled(Level::Debug) && utils_log::isEnabled(Level::Info));
+  assert(window(5000) == Level::Warning);
+  assert(window(5000) == Level::Warning);
+  assert(!utils_log::isEnabled(Level::Info) && utils_log::isEnabled(Level::Warning));
+  {
+    // a thread override does not escape the throttle
+    LOG_LEVEL_OVERRIDE(Level::Trace);
+    assert(!utils_log::isEnabled(Level::Debug) && utils_log::isEnabled(Level::Error));
+  }
+
+  // three windows under half the budget lower it one step
+  assert(window(100) == Level::Warning);
+  assert(window(100) == Level::Warning);
+  assert(window(100) == Level::Info);
+  // between half and the full budget: no change, and the quiet count restarts
+  assert(window(100) == Level::Info);
+  assert(window(100) == Level::Info);
+  assert(window(700) == Level::Info);
+  assert(window(100) == Level::Info);
+  assert(window(100) == Level::Info);
+  assert(window(100) == Level::Trace); // back to the configured level: not throttled
+  assert(utils_log::isEnabled(Level::Debug) && !utils_log::isEnabled(Level::Trace));
+
+  // an idle stretch counts as the quiet windows it spans
+  assert(window(5000) == Level::Info);
+  assert(window(0, 10) == Level::Trace);
+
+  // a window not yet over changes nothing
+  auto &b = utils_log::impl::logBudget();
+  b.bytes = 1000000;
+  utils_log::impl::checkLogBudget(now + second / 2);
+  assert(utils_log::impl::throttleLevel.load() == static_cast<int>(Level::Trace));
+
+  // each change is written once as a WARN record
+  utils_log::Log::terminate();
+  std::ifstream ifs("budget.log");
+  const std::string log((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  size_t changes = 0;
+  for (auto at = log.find("log budget:"); at != std::string::npos; at = log.find("log budget:", at + 1)) ++changes;
+  assert(changes == 6);
+  assert(log.find("WARN \"log budget: time 0.00%, 5000 B/s (budget 1000 B/s); level DEBUG -> INFO\"") != std::string::npos);
+  assert(log.find("level INFO -> WARN") != std::string::npos && log.find("level INFO -> DEBUG") != std::string::npos);
+  return 0;
+}
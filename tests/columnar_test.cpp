@@ -0,0 +1,120 @@
+// Author: Arman Sahakyan
+// Round trip: columnar blocks decode to the rows written, column by column;
+// a reader resyncs past a corrupt block, and a run appended to a file torn
+// by a crash starts cleanly after the last complete block.
+// Build: c++ -std=c++17 -O2 -I.. columnar_test.cpp -o columnar_test (tests/run.sh runs all)
+#include "utils_log/logger.hpp"
+#include "utils_log/columnar.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace col = utils_log::columnar;
+
+struct Row {
+  int64_t us;
+  uint64_t tid;
+  int level;
+  const char *file;
+  int line;
+  std::string msg;
+};
+
+static std::string readFile(const std::string &fname) {
+  std::ifstream ifs(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+static std::vector<std::string> messages(const std::string &image, size_t *skipped = nullptr) {
+  std::vector<std::string> out;
+  col::Reader reader(image);
+  col::Block b;
+  while (reader.next(b)) {
+    for (const auto &m : b.messages()) out.emplace_back(m);
+  }
+  if (skipped) *skipped = reader.skipped();
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    // second run of the logger, appending to the torn file
+    SET_LOG_OUTPUT_FILE_PATH("run.log");
+    SET_LOG_TO_CONSOLE(false);
+    SET_LOG_COLUMNAR(true);
+    for (int i = 0; i < 10; ++i) LOG_INFO << "second-" + std::to_string(i);
+    utils_log::Log::terminate();
+    return 0;
+  }
+
+  // encode/decode
+  static const char a[] = "a.cpp", b[] = "b.cpp";
+  std::vector<Row> rows;
+  for (int i = 0; i < 3000; ++i) {
+    rows.push_back(Row{ 1700000000000000 + (i % 7 == 0 ? -i : i * 13), 100 + static_cast<uint64_t>(i % 5), i % 6,
+      i % 3 ? a : b, i % 11, i % 9 ? "message " + std::to_string(i) : std::string() });
+  }
+  rows[42].msg = std::string("bytes\0\n\"\xff", 9);
+  rows[43].file = nullptr; // a record without a LOG_* site
+
+  std::string image(col::fileMagic, sizeof(col::fileMagic));
+  image += static_cast<char>(col::version);
+  col::BlockWriter writer;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const auto &r = rows[i];
+    writer.add(r.us, r.tid, r.level, r.file, r.line, r.msg);
+    if (writer.rows() == 1000) writer.finish(image);
+  }
+  writer.finish(image);
+  assert(col::isColumnar(image) && col::completeSize(image) == image.size());
+
+  size_t at = 0, blocks = 0;
+  col::Reader reader(image);
+  col::Block block;
+  while (reader.next(block)) {
+    ++blocks;
+    const auto times = block.times();
+    const auto tids = block.tids();
+    const auto levels = block.levels();
+    const auto sites = block.sites();
+    const auto msgs = block.messages();
+    assert(times.size() == block.rows && tids.size() == block.rows && levels.size() == block.rows);
+    assert(sites.size() == block.rows && msgs.size() == block.rows);
+    for (uint32_t i = 0; i < block.rows; ++i, ++at) {
+      const auto &r = rows[at];
+      assert(times[i] == r.us && tids[i] == r.tid && levels[i] == r.level && msgs[i] == r.msg);
+      assert(sites[i] == (r.file ? std::string(r.file) + ":" + std::to_string(r.line) : std::string()));
+    }
+  }
+  assert(blocks == 3 && at == rows.size() && reader.skipped() == 0);
+
+  // a corrupt block magic: the reader skips that block only
+  auto damaged = image;
+  damaged[damaged.find(std::string(col::blockMagic, sizeof(col::blockMagic)), col::fileHeaderSize + 1)] = 'X';
+  size_t skipped = 0;
+  assert(messages(damaged, &skipped).size() == 2000 && skipped > 0);
+
+  // a torn tail: completeSize() ends at the last complete block
+  const auto torn = image.substr(0, image.size() - 10);
+  assert(col::completeSize(torn) < torn.size() && messages(torn.substr(0, col::completeSize(torn))).size() == 2000);
+
+  // through the logger: a crash tears the last block, the next run appends
+  SET_LOG_OUTPUT_FILE_PATH("run.log");
+  SET_LOG_TO_CONSOLE(false);
+  SET_LOG_COLUMNAR(true);
+  for (int i = 0; i < 5000; ++i) LOG_INFO << "first-" + std::to_string(i);
+  utils_log::Log::terminate();
+  const auto full = std::filesystem::file_size("run.log.col");
+  std::filesystem::resize_file("run.log.col", full - 100);
+  assert(std::system((std::string(argv[0]) + " append").c_str()) == 0);
+
+  const auto appended = messages(readFile("run.log.col"), &skipped);
+  assert(skipped == 0 && appended.size() == 4096 + 10);
+  assert(appended[4095] == "first-4095" && appended[4096] == "second-0" && appended.back() == "second-9");
+  return 0;
+}
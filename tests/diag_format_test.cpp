@@ -0,0 +1,166 @@
+// Author: Arman Sahakyan
+// Round trip: binary diagnostics records (varints at their boundaries, zigzag
+// time deltas, strings, scope arguments) read back through diag::Reader; a cut
+// image reads as a prefix flagged truncated; a binary diagnostics.log decodes
+// to the same lines the text format writes.
+// Build: c++ -std=c++17 -O2 -I.. diag_format_test.cpp -o diag_format_test (tests/run.sh runs all)
+#include "utils_log/logger.hpp"
+#include "utils_log/diag_format.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace diag = utils_log::diag;
+
+static std::string readFile(const std::string &fname) {
+  std::ifstream ifs(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+// Scope lines without their "[date] " prefix.
+static std::vector<std::string> scopeLines(const std::string &text) {
+  std::vector<std::string> out;
+  std::istringstream iss(text);
+  for (std::string line; std::getline(iss, line);) {
+    if (line.size() > 22 && line[0] == '[') out.push_back(line.substr(22));
+  }
+  return out;
+}
+
+static void parse(const char *path, int size, char mode) {
+  LOG_START_ARGS(path, size, mode);
+  LOG_HERE("opened");
+  {
+    LOG_START1("header");
+    LOG_HERE("read \"quoted\"");
+  }
+}
+
+static int runLogger(bool binary) {
+  SET_LOG_TO_CONSOLE(false);
+  SET_LOG_DIAGNOSTICS(true);
+  SET_LOG_DIAGNOSTICS_FILE_PATH(binary ? "binary.diag" : "text.diag");
+  SET_LOG_DIAGNOSTICS_BINARY(binary);
+  parse("a.cfg", -12, 'r');
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) return runLogger(std::string(argv[1]) == "binary");
+
+  const uint64_t values[] = { 0, 1, 127, 128, 16383, 16384, (1ull << 32) - 1, 1ull << 32, 1ull << 62,
+    std::numeric_limits<uint64_t>::max() }; // the last one is -1 as a time
+  const int64_t deltas[] = { 0, 1, -1, 63, -64, 64, -65, std::numeric_limits<int32_t>::min(), 1ll << 40, -(1ll << 40) };
+
+  std::string image;
+  std::vector<diag::Event> expected;
+  std::vector<size_t> textSizes; // of the Text events, in order
+  for (const auto base : values) {
+    image.append(diag::magic, sizeof(diag::magic));
+    image += static_cast<char>(diag::version);
+    diag::putVarint(image, base);
+    auto now = static_cast<int64_t>(base);
+    diag::Event session;
+    session.type = diag::Session;
+    session.timeUs = now;
+    expected.push_back(session);
+
+    image += static_cast<char>(diag::SiteDef);
+    diag::putVarint(image, 0xffffffffu);
+    diag::putVarint(image, 77);
+    diag::putString(image, "func");
+    diag::putString(image, "file.cpp");
+    diag::putString(image, "a, b");
+
+    for (const auto dt : deltas) {
+      const std::string text(static_cast<size_t>(dt & 0xff), 'x');
+      image += static_cast<char>(diag::Text);
+      diag::putSigned(image, dt);
+      diag::putString(image, text);
+      diag::Event ev;
+      ev.type = diag::Text;
+      ev.timeUs = now += dt;
+      expected.push_back(ev);
+      textSizes.push_back(text.size());
+    }
+
+    image += static_cast<char>(diag::Enter | diag::typeNamed | diag::typeArgs);
+    diag::putSigned(image, -3);
+    diag::putVarint(image, 0xffffffffu);
+    diag::putVarint(image, 0xfffffffeu);
+    diag::putVarint(image, 128);
+    diag::putString(image, "name");
+    diag::putString(image, std::string("i\x01\0\0\0\0\0\0\0", 9));
+    diag::Event enter;
+    enter.type = diag::Enter;
+    enter.timeUs = now -= 3;
+    enter.site = 0xffffffffu;
+    enter.thread = 0xfffffffeu;
+    enter.depth = 128;
+    expected.push_back(enter);
+
+    image += static_cast<char>(diag::Here);
+    diag::putSigned(image, 5);
+    diag::putVarint(image, 0xffffffffu);
+    diag::putVarint(image, 1);
+    diag::putVarint(image, 0);
+    diag::putString(image, "here");
+    diag::Event here;
+    here.type = diag::Here;
+    here.timeUs = now += 5;
+    here.site = 0xffffffffu;
+    here.thread = 1;
+    expected.push_back(here);
+  }
+
+  {
+    diag::Reader r(image);
+    diag::Event ev;
+    size_t i = 0, texts = 0;
+    while (r.next(ev)) {
+      const auto &e = expected.at(i++);
+      assert(ev.type == e.type && ev.timeUs == e.timeUs);
+      if (ev.type == diag::Text) assert(ev.text.size() == textSizes.at(texts++) && ev.text.find_first_not_of('x') == std::string_view::npos);
+      if (ev.type == diag::Enter) {
+        assert(ev.site == e.site && ev.thread == e.thread && ev.depth == e.depth && ev.name == "name");
+        const auto *site = r.site(ev.site);
+        assert(site && site->func == "func" && site->file == "file.cpp" && site->line == 77);
+        assert(utils_log::formatScopeArgs(site->args, ev.args) == "a=1");
+      }
+      if (ev.type == diag::Here) assert(ev.site == e.site && ev.thread == 1 && ev.text == "here");
+    }
+    assert(i == expected.size() && texts == textSizes.size() && !r.truncated());
+  }
+
+  // any cut reads as a prefix of the events, never past the end
+  for (size_t cut = 0; cut < image.size(); cut += 3) {
+    diag::Reader r(std::string_view(image).substr(0, cut));
+    diag::Event ev;
+    size_t i = 0;
+    while (r.next(ev)) assert(ev.type == expected.at(i++).type);
+    assert(i <= expected.size());
+  }
+  {
+    diag::Reader r(std::string_view(image).substr(0, image.size() - 1));
+    diag::Event ev;
+    while (r.next(ev)) {}
+    assert(r.truncated());
+  }
+
+  // the logger: binary decodes to the text format's lines
+  const std::string self = argv[0];
+  assert(std::system((self + " text").c_str()) == 0);
+  assert(std::system((self + " binary").c_str()) == 0);
+  std::ostringstream decoded;
+  assert(utils_log::decodeDiagnostics("binary.diag", decoded));
+  const auto text = scopeLines(readFile("text.diag"));
+  assert(text.size() == 6 && text[0].find("parse:start... (path=\"a.cfg\", size=-12, mode='r')") != std::string::npos);
+  assert(scopeLines(decoded.str()) == text);
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Author: Arman Sahakyan
+// Round trip: with SET_LOG_REDACTION, no secret reaches any sink (output.log,
+// console, output.log.col, the bloom filter, volume shapes, a tail buffer,
+// diagnostics.log as text, binary and ring), and the masked forms do.
+// Build: c++ -std=c++17 -O2 -I.. redaction_test.cpp -o redaction_test (tests/run.sh runs all)
+#include "utils_log/logger.hpp"
+#include "utils_log/columnar.hpp"
+#include "utils_log/redact.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+static const char *const secret = "hunter2";
+static const char *const card = "4111 1111 1111 1111";
+
+static std::string readFile(const std::string &fname) {
+  std::ifstream ifs(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+static bool clean(const std::string &text) {
+  return text.find(secret) == std::string::npos && text.find(card) == std::string::npos
+    && text.find("4111111111111111") == std::string::npos;
+}
+
+static void login(const std::string &password, const char *number) {
+  LOG_START_ARGS(password, number);
+  LOG_HERE(std::string("checking ") + secret);
+  LOG_INFO << "login password=" + password + " card " + number;
+}
+
+int main(int argc, char *argv[]) {
+  const std::string mode = argc > 1 ? argv[1] : "text";
+  static const utils_log::Redactor redactor(utils_log::RedactionRules{ { secret }, { "password=" }, false, true });
+  SET_LOG_REDACTION(&redactor);
+  SET_LOG_OUTPUT_FILE_PATH(mode + ".log");
+  SET_LOG_DIAGNOSTICS_FILE_PATH(mode + ".diag");
+  SET_LOG_DIAGNOSTICS(true);
+  if (mode == "binary") SET_LOG_DIAGNOSTICS_BINARY(true);
+  if (mode == "ring") SET_LOG_DIAGNOSTICS_RING(64 * 1024);
+  SET_LOG_COLUMNAR(true);
+  SET_LOG_BLOOM_FILTER(1 << 16);
+  SET_LOG_VOLUME_ACCOUNTING(true);
+
+  std::ostringstream console;
+  auto *const prevCout = std::cout.rdbuf(console.rdbuf());
+  login(secret, card);
+  {
+    LOG_TAIL_BUFFER(utils_log::Level::Debug);
+    LOG_DEBUG << std::string("held ") + secret;
+    LOG_ERROR << std::string("failed with ") + card; // writes the held records
+  }
+  std::cout.rdbuf(prevCout);
+  const auto volume = utils_log::logVolumeReport();
+  const bool bloomHit = utils_log::impl::outputFile().bloom.mayContain(secret);
+  utils_log::Log::terminate();
+
+  const auto output = readFile(mode + ".log");
+  assert(clean(output) && output.find("password=***") != std::string::npos);
+  assert(output.find("held ***") != std::string::npos && output.find("************1111") != std::string::npos);
+  assert(clean(console.str()) && console.str().find("password=***") != std::string::npos);
+  assert(clean(volume));
+  assert(!bloomHit);
+
+  std::string columns;
+  const auto image = readFile(mode + ".log.col");
+  utils_log::columnar::Reader reader(image);
+  utils_log::columnar::Block block;
+  while (reader.next(block)) {
+    for (const auto &m : block.messages()) columns.append(m).append("\n");
+  }
+  assert(clean(columns) && columns.find("password=***") != std::string::npos);
+
+  std::ostringstream diag;
+  assert(utils_log::decodeDiagnostics(mode + ".diag", diag));
+  assert(clean(diag.str()) && clean(readFile(mode + ".diag")));
+  assert(diag.str().find("password=\"***\"") != std::string::npos);
+  assert(diag.str().find("checking ***") != std::string::npos);
+
+  // the binary and ring formats are chosen once per process
+  if (argc == 1) {
+    const std::string self = argv[0];
+    assert(std::system((self + " binary").c_str()) == 0);
+    assert(std::system((self + " ring").c_str()) == 0);
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Author: Arman Sahakyan
+# Builds and runs every tests/*_test.cpp, each a standalone program that
+# asserts and exits non-zero on failure; scratch files go to a temp dir.
+# Run from the repository root: tests/run.sh [compiler]
+set -e
+CXX=${1:-c++}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failed=0
+for src in "$ROOT"/tests/*_test.cpp; do
+  name=$(basename "$src" .cpp)
+  "$CXX" -std=c++17 -O1 -Wall -Wextra -I"$ROOT" "$src" -o "$TMP/$name" -pthread
+  mkdir "$TMP/$name.d"
+  if (cd "$TMP/$name.d" && "$TMP/$name"); then
+    echo "ok   $name"
+  else
+    echo "FAIL $name"
+    failed=1
+  fi
+done
+exit $failed
@@ -0,0 +1,62 @@
+// Author: Arman Sahakyan
+// Round trip: output.log written with SET_LOG_SEQUENCE / SET_LOG_CHECKSUM
+// passes verifyLog(), multi-line messages included; damage is reported.
+// Build: c++ -std=c++17 -O2 -I.. verify_test.cpp -o verify_test (tests/run.sh runs all)
+#include "utils_log/logger.hpp"
+#include "utils_log/verify.hpp"
+
+#include <cassert>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+static std::string readFile(const std::string &fname) {
+  std::ifstream ifs(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string &fname, const std::string &data) {
+  std::ofstream(fname, std::ios::binary | std::ios::trunc) << data;
+}
+
+int main() {
+  SET_LOG_OUTPUT_FILE_PATH("verify.log");
+  SET_LOG_TO_CONSOLE(false);
+  SET_LOG_SEQUENCE(utils_log::SequenceMode::Global);
+  SET_LOG_CHECKSUM(true);
+
+  for (int i = 0; i < 50; ++i) LOG_INFO << "record-" + std::to_string(i);
+  LOG_INFO << "line1\nline2\r\nline3";
+  LOG_INFO << "ends with endl" << std::endl;
+  LOG_WARN << "looks like a field: seq=1 seq=99";
+  LOG_INFO << "last";
+  utils_log::Log::terminate();
+
+  const auto good = utils_log::verifyLog("verify.log");
+  assert(good.ok());
+  assert(good.records == 54);
+  assert(good.checked == good.records);
+
+  const auto image = readFile("verify.log");
+  assert(image.find("line1\\nline2\\r\\nline3") != std::string::npos);
+
+  // a flipped byte inside one record
+  auto damaged = image;
+  damaged[damaged.find("record-7") + 7] = 'X';
+  writeFile("damaged.log", damaged);
+  const auto bad = utils_log::verifyLog("damaged.log");
+  assert(bad.corrupted == 1 && bad.gaps == 0 && !bad.ok());
+
+  // a lost record
+  const auto at = image.find("record-9");
+  const auto begin = image.rfind('\n', at) + 1;
+  const auto end = image.find('\n', at) + 1;
+  writeFile("gap.log", image.substr(0, begin) + image.substr(end));
+  const auto gap = utils_log::verifyLog("gap.log");
+  assert(gap.gaps == 1 && gap.missing == 1);
+
+  // a torn last record
+  writeFile("torn.log", image.substr(0, image.size() - 5));
+  assert(utils_log::verifyLog("torn.log").tornTail);
+  return 0;
+}
@@ -0,0 +1,75 @@
+// Author: Arman Sahakyan
+// Prints an output.log.col as tab-separated columns, decoding only those asked for.
+// Build: c++ -std=c++17 -O2 -I.. col_dump.cpp -o col_dump
+#include "utils_log/columnar.hpp"
+#include "utils_log/levels.hpp"
+#include "utils_log/mapped_file.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+int main(int argc, char *argv[]) {
+  namespace col = utils_log::columnar;
+  bool want[col::columnCount] = { true, true, true, true, false, true };
+  int first = 1;
+  if (argc > 2 && std::string(argv[1]) == "-c") {
+    for (auto &w : want) w = false;
+    std::istringstream names(argv[2]);
+    for (std::string name; std::getline(names, name, ',');) {
+      bool known = false;
+      for (int c = 0; c < col::columnCount; ++c) {
+        if (name == col::columnNames[c]) want[c] = known = true;
+      }
+      if (!known) {
+        std::cerr << "unknown column " << name << '\n';
+        return 2;
+      }
+    }
+    first = 3;
+  }
+  if (first >= argc) {
+    std::cerr << "usage: " << argv[0] << " [-c time,tid,level,site,length,message] <output.log.col>...\n";
+    return 2;
+  }
+
+  auto stamp = [](int64_t us) {
+    char frac[8];
+    std::snprintf(frac, sizeof(frac), ".%06lld", static_cast<long long>(((us % 1000000) + 1000000) % 1000000));
+    return utils_log::diag::formatTime(us) + frac;
+  };
+  for (int i = first; i < argc; ++i) {
+    utils_log::impl::MappedFile f(argv[i]);
+    const auto image = f.view();
+    if (!col::isColumnar(image)) {
+      std::cerr << argv[i] << ": not a columnar log\n";
+      continue;
+    }
+    col::Reader reader(image);
+    col::Block b;
+    while (reader.next(b)) {
+      const auto times = want[col::Time] ? b.times() : std::vector<int64_t>();
+      const auto tids = want[col::Tid] ? b.tids() : std::vector<uint64_t>();
+      const auto lvls = want[col::Level] ? b.levels() : std::vector<uint8_t>();
+      const auto sites = want[col::Site] ? b.sites() : std::vector<std::string_view>();
+      const auto msgs = want[col::MsgBytes] || want[col::MsgLength] ? b.messages() : std::vector<std::string_view>();
+      for (uint32_t r = 0; r < b.rows; ++r) {
+        std::string line;
+        auto field = [&](std::string_view v) {
+          if (!line.empty()) line += '\t';
+          line.append(v.data(), v.size());
+        };
+        if (want[col::Time]) field(r < times.size() ? stamp(times[r]) : "");
+        if (want[col::Tid]) field(r < tids.size() ? std::to_string(tids[r]) : "");
+        if (want[col::Level]) field(r < lvls.size() && lvls[r] < std::size(utils_log::levelNames) ? utils_log::levelNames[lvls[r]] : "");
+        if (want[col::Site]) field(r < sites.size() ? sites[r] : "");
+        if (want[col::MsgLength]) field(r < msgs.size() ? std::to_string(msgs[r].size()) : "");
+        if (want[col::MsgBytes]) field(r < msgs.size() ? msgs[r] : "");
+        std::cout << line << '\n';
+      }
+    }
+    if (reader.skipped()) std::cerr << argv[i] << ": skipped " << reader.skipped() << " torn or corrupt bytes\n";
+  }
+  return 0;
+}
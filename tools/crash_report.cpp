@@ -0,0 +1,18 @@
+// Author: Arman Sahakyan
+// Prints the open scopes per thread at the end of a diagnostics.log.
+// Build: c++ -std=c++17 -O2 -I.. crash_report.cpp -o crash_report
+// Usage: crash_report [diagnostics.log]
+#include <iostream>
+
+#include "utils_log/crash_analysis.hpp"
+
+int main(int argc, char *argv[]) {
+  const char *fname = argc > 1 ? argv[1] : "diagnostics.log";
+  const auto analysis = utils_log::analyzeDiagnosticsFile(fname);
+  if (!analysis.crashed()) {
+    std::cout << fname << ": no open scopes at the end\n";
+    return 0;
+  }
+  std::cout << utils_log::crashSummary(analysis) << '\n';
+  return 2;
+}
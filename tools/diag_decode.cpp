@@ -0,0 +1,16 @@
+// Author: Arman Sahakyan
+// Prints a binary diagnostics.log (SET_LOG_DIAGNOSTICS_BINARY) as text.
+// Build: c++ -std=c++17 -O2 -I.. diag_decode.cpp -o diag_decode
+// Usage: diag_decode [diagnostics.log]
+#include <iostream>
+
+#include "utils_log/diag_format.hpp"
+
+int main(int argc, char *argv[]) {
+  const char *fname = argc > 1 ? argv[1] : "diagnostics.log";
+  if (!utils_log::decodeDiagnostics(fname, std::cout)) {
+    std::cerr << fname << ": cannot read or truncated record\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+// Author: Arman Sahakyan
+// Searches an output.log and its rotations (.old, .gz, .gz.old) on all cores.
+// Build: c++ -std=c++17 -O2 -I.. log_search.cpp -o log_search -pthread
+//        (add -DUTILS_LOG_ZLIB -lz for compressed segments)
+#include "utils_log/search.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  utils_log::SearchQuery q;
+  bool countOnly = false, withNames = false, verbose = false, haveText = false;
+  std::vector<std::string> segments;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    auto value = [&] { return i + 1 < argc ? std::string(argv[++i]) : std::string(); };
+    if (a == "--from") q.from = value();
+    else if (a == "--to") q.to = value();
+    else if (a == "--tid") {
+      q.anyTid = false;
+      q.tid = std::strtoull(value().c_str(), nullptr, 10);
+    } else if (a == "--level") {
+      const auto name = value();
+      q.minLevel = -1;
+      for (int l = 0; l < static_cast<int>(utils_log::Level::Off); ++l) {
+        if (name == utils_log::levelNames[l]) q.minLevel = l;
+      }
+      if (q.minLevel < 0) {
+        std::cerr << "unknown level " << name << '\n';
+        return 2;
+      }
+    } else if (a == "-j") q.threads = static_cast<unsigned>(std::atoi(value().c_str()));
+    else if (a == "-c") countOnly = true;
+    else if (a == "-H") withNames = true;
+    else if (a == "-w") q.wholeWord = true;
+    else if (a == "-v") verbose = true;
+    else if (!haveText) {
+      q.text = a;
+      haveText = true;
+    } else {
+      // an output.log stands for itself and its rotations
+      auto rotated = utils_log::logSegments(a);
+      if (rotated.empty()) rotated.push_back(a);
+      segments.insert(segments.end(), rotated.begin(), rotated.end());
+    }
+  }
+  if (!haveText || segments.empty()) {
+    std::cerr << "usage: " << argv[0] << " [--from T] [--to T] [--tid N] [--level L] [-j N] [-c] [-H] [-w] [-v] <text> <output.log>...\n"
+      << "  T: \"YYYY-MM-DD[ HH:MM:SS]\"; L: TRACE DEBUG INFO WARN ERROR FATAL; text \"\" matches every record\n"
+      << "  -w: whole word, skips segments whose .bloom sidecar rules it out; -v: report skipped segments\n";
+    return 2;
+  }
+
+  const auto r = utils_log::searchLogs(segments, q);
+  for (const auto &e : r.errors) std::cerr << e << '\n';
+  if (verbose) std::cerr << r.skipped << " of " << segments.size() << " segment(s) skipped by their Bloom filter\n";
+  if (countOnly) {
+    std::cout << r.hits.size() << '\n';
+  } else {
+    for (const auto &h : r.hits) {
+      if (withNames) std::cout << segments[h.segment] << ':';
+      std::cout << h.line << '\n';
+    }
+  }
+  return r.hits.empty() ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+// Author: Arman Sahakyan
+// Resolves the " bt=" stack traces of an output.log offline, through addr2line.
+// Build: c++ -std=c++17 -O2 log_symbolize.cpp -o log_symbolize
+// Usage: log_symbolize [output.log]   (reads stdin without an argument)
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+  struct Frame {
+    std::string module; // empty when only an absolute address is known
+    unsigned long long offset = 0;
+  };
+
+  std::vector<Frame> parseTrace(const std::string &bt) {
+    std::vector<Frame> frames;
+    std::string prevModule;
+    size_t pos = 0;
+    while (pos < bt.size()) {
+      auto end = bt.find(',', pos);
+      if (end == std::string::npos) end = bt.size();
+      const auto tok = bt.substr(pos, end - pos);
+      pos = end + 1;
+
+      Frame f;
+      const auto plus = tok.rfind('+');
+      if (plus == std::string::npos) {
+        f.offset = std::stoull(tok, nullptr, 16);
+      } else {
+        f.module = plus == 0 ? prevModule : tok.substr(0, plus);
+        f.offset = std::stoull(tok.substr(plus + 1), nullptr, 16);
+        prevModule = f.module;
+      }
+      frames.push_back(f);
+    }
+    return frames;
+  }
+
+  // Output of `addr2line -f -C -e module pc`, run without a shell: the
+  // module comes from the log file.
+  std::string addr2line(const std::string &module, const char *pc) {
+    int fds[2];
+    if (::pipe(fds) != 0) return {};
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+      ::close(fds[0]);
+      ::close(fds[1]);
+      return {};
+    }
+    if (pid == 0) {
+      ::dup2(fds[1], STDOUT_FILENO);
+      ::close(fds[0]);
+      ::close(fds[1]);
+      if (const int null = ::open("/dev/null", O_WRONLY); null >= 0) ::dup2(null, STDERR_FILENO);
+      const char *argv[] = { "addr2line", "-f", "-C", "-e", module.c_str(), pc, nullptr };
+      ::execvp(argv[0], const_cast<char *const *>(argv));
+      ::_exit(127);
+    }
+    ::close(fds[1]);
+    std::string out;
+    char buf[4096];
+    for (ssize_t n; (n = ::read(fds[0], buf, sizeof(buf))) > 0;) out.append(buf, static_cast<size_t>(n));
+    ::close(fds[0]);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    return out;
+  }
+
+  // "function at file:line", cached per module and offset.
+  std::string resolve(const Frame &f) {
+    static std::map<std::pair<std::string, unsigned long long>, std::string> cache;
+    char addr[32];
+    std::snprintf(addr, sizeof(addr), "0x%llx", f.offset);
+    if (f.module.empty()) return addr;
+
+    const auto key = std::make_pair(f.module, f.offset);
+    if (auto it = cache.find(key); it != cache.end()) return it->second;
+
+    // return addresses point past the call; look up the call instruction
+    char pc[32];
+    std::snprintf(pc, sizeof(pc), "0x%llx", f.offset ? f.offset - 1 : 0);
+    const auto text = addr2line(f.module, pc);
+    const auto nl = text.find('\n');
+    std::string func = text.substr(0, nl);
+    std::string where = nl == std::string::npos ? std::string() : text.substr(nl + 1);
+    where = where.substr(0, where.find('\n'));
+    auto trim = [](std::string &s) { while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back(); };
+    trim(func);
+    trim(where);
+    std::string out = (func.empty() ? std::string("??") : func) + " at " + (where.empty() ? std::string("??") : where)
+      + " (" + f.module + "+" + addr + ")";
+    cache.emplace(key, out);
+    return out;
+  }
+
+  void process(std::istream &in) {
+    std::string line;
+    while (std::getline(in, line)) {
+      std::cout << line << '\n';
+      // the field follows the message's closing quote; " bt=" inside the message is text
+      const auto close = line.rfind('"');
+      if (close == std::string::npos) continue;
+      const auto pos = line.find(" bt=", close);
+      if (pos == std::string::npos) continue;
+      auto end = line.find(' ', pos + 4);
+      if (end == std::string::npos) end = line.size();
+      const auto frames = parseTrace(line.substr(pos + 4, end - pos - 4));
+      for (size_t i = 0; i < frames.size(); ++i)
+        std::cout << "    #" << i << ' ' << resolve(frames[i]) << '\n';
+    }
+  }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    process(std::cin);
+    return 0;
+  }
+  std::ifstream ifs(argv[1]);
+  if (!ifs.is_open()) {
+    std::cerr << "cannot open " << argv[1] << '\n';
+    return 1;
+  }
+  process(ifs);
+  return 0;
+}
@@ -0,0 +1,23 @@
+// Author: Arman Sahakyan
+// Reports sequence gaps and corrupted records in an output.log.
+// Build: c++ -std=c++17 -O2 -I.. log_verify.cpp -o log_verify
+#include "utils_log/verify.hpp"
+
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <output.log>...\n";
+    return 2;
+  }
+  bool allOk = true;
+  for (int i = 1; i < argc; ++i) {
+    const auto r = utils_log::verifyLog(argv[i]);
+    for (const auto &s : r.issues) std::cout << argv[i] << ": " << s << '\n';
+    std::cout << argv[i] << ": " << r.records << " records, " << r.checked << " checksummed, "
+      << r.corrupted << " corrupted, " << r.gaps << " gaps (" << r.missing << " missing), "
+      << r.reordered << " reordered" << (r.tornTail ? ", torn tail" : "") << '\n';
+    allOk = allOk && r.ok();
+  }
+  return allOk ? 0 : 1;
+}
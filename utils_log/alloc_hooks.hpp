@@ -0,0 +1,77 @@
+// Author: Arman Sahakyan
+#pragma once
+// Replaceable global operator new/delete that charge every allocation's count
+// and size to the calling thread's innermost LOG_START scope (see
+// scopeAllocationReport()). Opt-in: include this header in exactly one .cpp
+// of the program. The cost per allocation is a thread-local load and two adds.
+#include <cstdlib>
+#include <new>
+
+#include "log.hpp"
+
+namespace utils_log::impl {
+
+  inline void *allocateCounted(std::size_t n) {
+    countAllocation(n);
+    if (n == 0) n = 1;
+    for (;;) {
+      if (void *p = std::malloc(n)) return p;
+      if (auto handler = std::get_new_handler()) handler();
+      else throw std::bad_alloc();
+    }
+  }
+
+  inline void *allocateCounted(std::size_t n, std::align_val_t al) {
+    countAllocation(n);
+    const auto align = static_cast<std::size_t>(al) < sizeof(void *) ? sizeof(void *) : static_cast<std::size_t>(al);
+    const std::size_t size = (n + align - 1) / align * align;
+    for (;;) {
+#ifdef _WIN32
+      if (void *p = ::_aligned_malloc(size ? size : align, align)) return p;
+#else
+      if (void *p = std::aligned_alloc(align, size ? size : align)) return p;
+#endif
+      if (auto handler = std::get_new_handler()) handler();
+      else throw std::bad_alloc();
+    }
+  }
+
+  inline void freeAligned(void *p) noexcept {
+#ifdef _WIN32
+    ::_aligned_free(p);
+#else
+    std::free(p);
+#endif
+  }
+
+} // namespace utils_log::impl
+
+void *operator new(std::size_t n) { return utils_log::impl::allocateCounted(n); }
+void *operator new[](std::size_t n) { return utils_log::impl::allocateCounted(n); }
+void *operator new(std::size_t n, const std::nothrow_t &) noexcept {
+  try { return utils_log::impl::allocateCounted(n); } catch (...) { return nullptr; }
+}
+void *operator new[](std::size_t n, const std::nothrow_t &) noexcept {
+  try { return utils_log::impl::allocateCounted(n); } catch (...) { return nullptr; }
+}
+void *operator new(std::size_t n, std::align_val_t al) { return utils_log::impl::allocateCounted(n, al); }
+void *operator new[](std::size_t n, std::align_val_t al) { return utils_log::impl::allocateCounted(n, al); }
+void *operator new(std::size_t n, std::align_val_t al, const std::nothrow_t &) noexcept {
+  try { return utils_log::impl::allocateCounted(n, al); } catch (...) { return nullptr; }
+}
+void *operator new[](std::size_t n, std::align_val_t al, const std::nothrow_t &) noexcept {
+  try { return utils_log::impl::allocateCounted(n, al); } catch (...) { return nullptr; }
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { utils_log::impl::freeAligned(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { utils_log::impl::freeAligned(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { utils_log::impl::freeAligned(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { utils_log::impl::freeAligned(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { utils_log::impl::freeAligned(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { utils_log::impl::freeAligned(p); }
@@ -0,0 +1,128 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace utils_log::impl {
+
+  // ============================================================================
+  //                      TokenBloom (output.log sidecar)
+  // ============================================================================
+  // Bloom filter of the message tokens of one output.log segment, saved next
+  // to it as "<segment>.bloom". Tokens are runs of letters, digits, '-' and
+  // '_' at least minToken long. The header records the segment size the filter
+  // covers; a reader uses it only while the segment still has that size.
+  struct BloomHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t hashes;
+    uint32_t minToken;
+    uint64_t bits;
+    uint64_t coveredBytes;
+  };
+
+  inline constexpr char bloomMagic[4] = { 'U', 'L', 'B', 'F' };
+
+  inline bool isTokenChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+  }
+
+  template <typename F>
+  void forEachToken(std::string_view text, size_t minToken, F &&f) {
+    size_t i = 0;
+    while (i < text.size()) {
+      while (i < text.size() && !isTokenChar(text[i])) ++i;
+      const size_t b = i;
+      while (i < text.size() && isTokenChar(text[i])) ++i;
+      if (i - b >= minToken) f(text.substr(b, i - b));
+    }
+  }
+
+  inline uint64_t tokenHash(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ull; // FNV-1a, then a murmur finalizer
+    for (char c : s) h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  class TokenBloom {
+  public:
+    static constexpr uint32_t hashes = 4;
+
+    void reset(uint64_t bits, uint32_t minToken) {
+      bits_ = bits < 64 ? 64 : bits;
+      minToken_ = minToken;
+      words_.assign(static_cast<size_t>((bits_ + 63) / 64), 0);
+    }
+
+    bool enabled() const { return !words_.empty(); }
+    uint32_t minToken() const { return minToken_; }
+
+    void addTokens(std::string_view text) {
+      forEachToken(text, minToken_, [this](std::string_view t) { add(t); });
+    }
+
+    void add(std::string_view token) {
+      const auto h = tokenHash(token);
+      for (uint32_t i = 0; i < hashes; ++i) {
+        const auto bit = slot(h, i);
+        words_[static_cast<size_t>(bit / 64)] |= 1ull << (bit % 64);
+      }
+    }
+
+    bool mayContain(std::string_view token) const {
+      const auto h = tokenHash(token);
+      for (uint32_t i = 0; i < hashes; ++i) {
+        const auto bit = slot(h, i);
+        if (!(words_[static_cast<size_t>(bit / 64)] & (1ull << (bit % 64)))) return false;
+      }
+      return true;
+    }
+
+    bool save(const std::string &fname, uint64_t coveredBytes) const {
+      BloomHeader h{};
+      std::memcpy(h.magic, bloomMagic, sizeof(bloomMagic));
+      h.version = 1;
+      h.hashes = hashes;
+      h.minToken = minToken_;
+      h.bits = bits_;
+      h.coveredBytes = coveredBytes;
+      std::ofstream ofs(fname, std::ios::binary | std::ios::trunc);
+      ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+      ofs.write(reinterpret_cast<const char *>(words_.data()), static_cast<std::streamsize>(words_.size() * sizeof(uint64_t)));
+      return ofs.good();
+    }
+
+    // False unless image is a filter covering exactly coveredBytes.
+    bool load(std::string_view image, uint64_t coveredBytes) {
+      BloomHeader h{};
+      if (image.size() < sizeof(h)) return false;
+      std::memcpy(&h, image.data(), sizeof(h));
+      if (std::memcmp(h.magic, bloomMagic, sizeof(bloomMagic)) != 0 || h.version != 1 || h.hashes != hashes
+        || h.coveredBytes != coveredBytes || !h.bits || image.size() != sizeof(h) + (h.bits + 63) / 64 * sizeof(uint64_t))
+        return false;
+      reset(h.bits, h.minToken);
+      std::memcpy(words_.data(), image.data() + sizeof(h), words_.size() * sizeof(uint64_t));
+      return true;
+    }
+
+  private:
+    uint64_t bits_ = 0;
+    uint32_t minToken_ = 0;
+    std::vector<uint64_t> words_;
+
+    // double hashing: h1 + i * h2
+    uint64_t slot(uint64_t h, uint32_t i) const {
+      const uint64_t h1 = h & 0xffffffffull, h2 = (h >> 32) | 1;
+      return (h1 + i * h2) % bits_;
+    }
+  };
+
+} // namespace utils_log::impl
@@ -0,0 +1,273 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "diag_format.hpp"
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                      Columnar output.log (output.log.col)
+  // ============================================================================
+  // A file header (magic "ULCL", version 1), then blocks of up to a few
+  // thousand records, each a fixed header and one chunk per column:
+  //
+  //   BlockHeader  magic "ULCB", rows, byte size of each column chunk
+  //   Time         zigzag varint us since epoch of the first row, then deltas
+  //   Tid          varint dictionary size, the tids (varint), one varint index per row
+  //   Level        one byte per row (Level)
+  //   Site         varint dictionary size, "file:line" strings, one varint index per row
+  //   MsgLength    one varint per row
+  //   MsgBytes     the messages back to back
+  //
+  // Dictionaries are per block, so every block decodes on its own; a reader
+  // finds any column from the header without touching the others.
+  namespace columnar {
+
+    enum Column : uint8_t { Time, Tid, Level, Site, MsgLength, MsgBytes, columnCount };
+
+    inline constexpr const char *columnNames[columnCount] = { "time", "tid", "level", "site", "length", "message" };
+    inline constexpr char fileMagic[4] = { 'U', 'L', 'C', 'L' };
+    inline constexpr char blockMagic[4] = { 'U', 'L', 'C', 'B' };
+    inline constexpr uint8_t version = 1;
+    inline constexpr size_t fileHeaderSize = sizeof(fileMagic) + 1;
+
+    struct BlockHeader {
+      char magic[4];
+      uint32_t rows;
+      uint32_t sizes[columnCount];
+    };
+
+    // Accumulates rows column by column; finish() appends the block.
+    class BlockWriter {
+    public:
+      void add(int64_t us, uint64_t tid, int level, const char *file, int line, std::string_view msg) {
+        diag::putSigned(time_, rows_ ? us - lastUs_ : us);
+        lastUs_ = us;
+
+        auto t = tidIndex_.try_emplace(tid, static_cast<uint32_t>(tids_.size()));
+        if (t.second) tids_.push_back(tid);
+        diag::putVarint(tid_, t.first->second);
+
+        level_.push_back(static_cast<char>(level));
+
+        auto s = siteIndex_.try_emplace(std::make_pair(file, line), static_cast<uint32_t>(sites_.size()));
+        if (s.second) sites_.push_back(file ? std::string(file) + ":" + std::to_string(line) : std::string());
+        diag::putVarint(site_, s.first->second);
+
+        diag::putVarint(msgLength_, msg.size());
+        msg_.append(msg.data(), msg.size());
+        ++rows_;
+      }
+
+      uint32_t rows() const { return rows_; }
+      size_t bytes() const { return time_.size() + tid_.size() + level_.size() + site_.size() + msgLength_.size() + msg_.size(); }
+
+      void finish(std::string &out) {
+        if (!rows_) return;
+        std::string tids, sites;
+        diag::putVarint(tids, tids_.size());
+        for (auto t : tids_) diag::putVarint(tids, t);
+        diag::putVarint(sites, sites_.size());
+        for (const auto &s : sites_) diag::putString(sites, s);
+
+        const std::string *chunks[][2] = {
+          { &time_, nullptr }, { &tids, &tid_ }, { &level_, nullptr }, { &sites, &site_ }, { &msgLength_, nullptr }, { &msg_, nullptr },
+        };
+        BlockHeader h{};
+        std::memcpy(h.magic, blockMagic, sizeof(blockMagic));
+        h.rows = rows_;
+        for (int c = 0; c < columnCount; ++c)
+          h.sizes[c] = static_cast<uint32_t>(chunks[c][0]->size() + (chunks[c][1] ? chunks[c][1]->size() : 0));
+        out.append(reinterpret_cast<const char *>(&h), sizeof(h));
+        for (auto &chunk : chunks) {
+          for (const auto *part : chunk) {
+            if (part) out += *part;
+          }
+        }
+        *this = BlockWriter();
+      }
+
+    private:
+      uint32_t rows_ = 0;
+      int64_t lastUs_ = 0;
+      std::string time_, tid_, level_, site_, msgLength_, msg_;
+      std::vector<uint64_t> tids_;
+      std::unordered_map<uint64_t, uint32_t> tidIndex_;
+      std::vector<std::string> sites_;
+      std::map<std::pair<const char *, int>, uint32_t> siteIndex_;
+    };
+
+    class Cursor {
+    public:
+      explicit Cursor(std::string_view data) : data_(data) {}
+
+      bool varint(uint64_t &v) {
+        v = 0;
+        for (int shift = 0; pos_ < data_.size() && shift < 64; shift += 7) {
+          const auto b = static_cast<uint8_t>(data_[pos_++]);
+          v |= static_cast<uint64_t>(b & 0x7F) << shift;
+          if (!(b & 0x80)) return true;
+        }
+        return false;
+      }
+
+      bool zigzag(int64_t &v) {
+        uint64_t u = 0;
+        if (!varint(u)) return false;
+        v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+        return true;
+      }
+
+      bool bytes(size_t n, std::string_view &out) {
+        if (n > data_.size() - pos_) return false;
+        out = data_.substr(pos_, n);
+        pos_ += n;
+        return true;
+      }
+
+    private:
+      std::string_view data_;
+      size_t pos_ = 0;
+    };
+
+    // One block's column chunks; each decoder reads only its own.
+    struct Block {
+      uint32_t rows = 0;
+      std::string_view columns[columnCount];
+
+      std::vector<int64_t> times() const {
+        std::vector<int64_t> out;
+        Cursor c(columns[Time]);
+        int64_t us = 0, d = 0;
+        while (out.size() < rows && c.zigzag(d)) out.push_back(us += d);
+        return out;
+      }
+
+      std::vector<uint64_t> tids() const {
+        std::vector<uint64_t> dict, out;
+        Cursor c(columns[Tid]);
+        uint64_t n = 0, v = 0;
+        if (!c.varint(n)) return out;
+        for (uint64_t i = 0; i < n && c.varint(v); ++i) dict.push_back(v);
+        while (out.size() < rows && c.varint(v)) out.push_back(v < dict.size() ? dict[v] : 0);
+        return out;
+      }
+
+      std::vector<uint8_t> levels() const {
+        return std::vector<uint8_t>(columns[Level].begin(), columns[Level].end());
+      }
+
+      std::vector<std::string_view> sites() const {
+        std::vector<std::string_view> dict, out;
+        Cursor c(columns[Site]);
+        uint64_t n = 0, v = 0;
+        if (!c.varint(n)) return out;
+        std::string_view s;
+        for (uint64_t i = 0; i < n && c.varint(v) && c.bytes(v, s); ++i) dict.push_back(s);
+        while (out.size() < rows && c.varint(v)) out.push_back(v < dict.size() ? dict[v] : std::string_view());
+        return out;
+      }
+
+      std::vector<std::string_view> messages() const {
+        std::vector<std::string_view> out;
+        Cursor lengths(columns[MsgLength]), bytes(columns[MsgBytes]);
+        uint64_t n = 0;
+        std::string_view m;
+        while (out.size() < rows && lengths.varint(n) && bytes.bytes(n, m)) out.push_back(m);
+        return out;
+      }
+    };
+
+    inline bool isColumnar(std::string_view head) {
+      return head.size() >= sizeof(fileMagic) && std::memcmp(head.data(), fileMagic, sizeof(fileMagic)) == 0;
+    }
+
+    // Byte size of the complete block at the start of `data`; 0 if it is torn
+    // or not a block.
+    inline size_t blockSize(std::string_view data, BlockHeader &h) {
+      if (data.size() < sizeof(h)) return 0;
+      std::memcpy(&h, data.data(), sizeof(h));
+      if (std::memcmp(h.magic, blockMagic, sizeof(blockMagic)) != 0) return 0;
+      size_t at = sizeof(h);
+      for (int c = 0; c < columnCount; ++c) {
+        if (h.sizes[c] > data.size() - at) return 0;
+        at += h.sizes[c];
+      }
+      return at;
+    }
+
+    // Length of the image up to the end of its last complete block (or file
+    // header): what an appender keeps of a file torn by a crash.
+    inline size_t completeSize(std::string_view image) {
+      size_t pos = 0;
+      BlockHeader h{};
+      while (pos < image.size()) {
+        const auto rest = image.substr(pos);
+        if (isColumnar(rest) && rest.size() >= fileHeaderSize) pos += fileHeaderSize;
+        else if (const auto n = blockSize(rest, h)) pos += n;
+        else break;
+      }
+      return pos;
+    }
+
+    // Blocks of an output.log.col image in file order; a torn or corrupt block
+    // is skipped up to the next block or file magic (see skipped()).
+    class Reader {
+    public:
+      explicit Reader(std::string_view image) : data_(image) {}
+
+      bool next(Block &b) {
+        while (pos_ < data_.size()) {
+          const auto rest = data_.substr(pos_);
+          if (isColumnar(rest)) {
+            pos_ += fileHeaderSize; // a new run
+            continue;
+          }
+          BlockHeader h{};
+          const auto n = blockSize(rest, h);
+          if (!n) {
+            resync();
+            continue;
+          }
+          size_t at = sizeof(h);
+          for (int c = 0; c < columnCount; ++c) {
+            b.columns[c] = rest.substr(at, h.sizes[c]);
+            at += h.sizes[c];
+          }
+          b.rows = h.rows;
+          pos_ += n;
+          return true;
+        }
+        return false;
+      }
+
+      // Bytes passed over as torn or corrupt.
+      size_t skipped() const { return skipped_; }
+
+    private:
+      std::string_view data_;
+      size_t pos_ = 0;
+      size_t skipped_ = 0;
+
+      void resync() {
+        const auto block = data_.find(std::string_view(blockMagic, sizeof(blockMagic)), pos_ + 1);
+        const auto file = data_.find(std::string_view(fileMagic, sizeof(fileMagic)), pos_ + 1);
+        const auto to = std::min(std::min(block, file), data_.size());
+        skipped_ += to - pos_;
+        pos_ = to;
+      }
+    };
+
+  } // namespace columnar
+
+} // namespace utils_log
@@ -0,0 +1,300 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "diag_format.hpp"
+#include "mapped_file.hpp"
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                      Crash-point analysis (diagnostics.log)
+  // ============================================================================
+  // One pass over the last session of a diagnostics.log (text, binary or ring)
+  // that replays scope enter/exit per thread. Whatever is still open when the
+  // records end is where each thread was when the process died.
+  struct OpenScope {
+    std::string func;     // "func" or "func:name"
+    std::string file;
+    std::string args;     // formatted LOG_START_ARGS arguments
+    int64_t enterUs = 0;  // us since epoch; second resolution for text files
+    std::string lastHere; // last LOG_HERE message in this scope
+    int64_t lastHereUs = 0;
+  };
+
+  struct ThreadScopes {
+    uint32_t thread = 0;
+    int64_t lastUs = 0;
+    std::vector<OpenScope> scopes; // outermost first
+  };
+
+  struct CrashAnalysis {
+    int lastCount = -1;  // open scope count of the last scope record, -1 without one
+    int64_t lastUs = 0;  // time of the last record
+    std::vector<ThreadScopes> threads; // threads with open scopes only
+
+    bool crashed() const { return lastCount > 0; }
+  };
+
+  namespace impl {
+
+    class ScopeReplay {
+    public:
+      void reset() {
+        threads_.clear();
+        result_ = CrashAnalysis{};
+      }
+
+      void enter(uint32_t thread, int64_t us, std::string func, std::string_view file, std::string args, int count) {
+        auto &t = touch(thread, us, count);
+        t.scopes.push_back(OpenScope{ std::move(func), std::string(file), std::move(args), us, {}, 0 });
+      }
+
+      void exit(uint32_t thread, int64_t us, std::string_view func, int count) {
+        auto &t = touch(thread, us, count);
+        // normally the top; tolerate records lost to a ring wrap
+        for (auto i = t.scopes.size(); i-- > 0;) {
+          if (t.scopes[i].func == func) {
+            t.scopes.resize(i);
+            return;
+          }
+        }
+      }
+
+      void here(uint32_t thread, int64_t us, std::string_view msg, int count) {
+        auto &t = touch(thread, us, count);
+        if (t.scopes.empty()) return;
+        t.scopes.back().lastHere.assign(msg.data(), msg.size());
+        t.scopes.back().lastHereUs = us;
+      }
+
+      const ThreadScopes *thread(uint32_t id) const {
+        const auto it = threads_.find(id);
+        return it == threads_.end() ? nullptr : &it->second;
+      }
+
+      void time(int64_t us) { result_.lastUs = us; }
+
+      CrashAnalysis finish() {
+        for (auto &[id, t] : threads_) {
+          if (!t.scopes.empty()) result_.threads.push_back(std::move(t));
+        }
+        threads_.clear();
+        return std::move(result_);
+      }
+
+    private:
+      std::map<uint32_t, ThreadScopes> threads_;
+      CrashAnalysis result_;
+
+      ThreadScopes &touch(uint32_t thread, int64_t us, int count) {
+        auto &t = threads_[thread];
+        t.thread = thread;
+        t.lastUs = us;
+        result_.lastUs = us;
+        result_.lastCount = count;
+        return t;
+      }
+    };
+
+    // "[YYYY-MM-DD HH:MM:SS]" in local time; the previous result is reused for
+    // the same second.
+    inline int64_t parseTextTime(std::string_view stamp) {
+      static thread_local char prev[20] = {};
+      static thread_local int64_t prevUs = 0;
+      if (stamp.size() < 19) return 0;
+      if (std::memcmp(prev, stamp.data(), 19) == 0) return prevUs;
+      std::tm tm{};
+      int y = 0, mo = 0, d = 0, h = 0, mi = 0, s = 0;
+      const std::string str(stamp.substr(0, 19));
+      if (std::sscanf(str.c_str(), "%d-%d-%d %d:%d:%d", &y, &mo, &d, &h, &mi, &s) != 6) return 0;
+      tm.tm_year = y - 1900;
+      tm.tm_mon = mo - 1;
+      tm.tm_mday = d;
+      tm.tm_hour = h;
+      tm.tm_min = mi;
+      tm.tm_sec = s;
+      tm.tm_isdst = -1;
+      std::memcpy(prev, stamp.data(), 19);
+      prevUs = static_cast<int64_t>(std::mktime(&tm)) * 1000000;
+      return prevUs;
+    }
+
+    // "[date] tN func:phase file |count"; free-form lines are skipped.
+    inline void replayTextLine(ScopeReplay &r, std::string_view line) {
+      if (line.rfind("## CRASH POINT ##", 0) == 0) {
+        r.reset(); // a new session that followed a crash
+        return;
+      }
+      if (line.size() < 22 || line[0] != '[' || line[20] != ']') return;
+      const int64_t us = parseTextTime(line.substr(1));
+      auto rest = line.substr(22);
+      if (rest.rfind("## ", 0) == 0) {
+        r.time(us);
+        return;
+      }
+
+      uint32_t thread = 0;
+      if (rest.size() > 1 && rest[0] == 't' && rest[1] >= '0' && rest[1] <= '9') {
+        size_t i = 1;
+        while (i < rest.size() && rest[i] >= '0' && rest[i] <= '9') thread = thread * 10 + static_cast<uint32_t>(rest[i++] - '0');
+        if (i >= rest.size() || rest[i] != ' ') return;
+        rest.remove_prefix(i + 1);
+      }
+
+      const auto bar = rest.rfind(" |");
+      if (bar == std::string_view::npos) return;
+      int count = 0;
+      for (size_t i = bar + 2; i < rest.size() && rest[i] >= '0' && rest[i] <= '9'; ++i) count = count * 10 + (rest[i] - '0');
+      rest = rest.substr(0, bar);
+      const auto sp = rest.rfind(' ');
+      if (sp == std::string_view::npos) return;
+      const auto file = rest.substr(sp + 1);
+      const auto event = rest.substr(0, sp);
+
+      constexpr std::string_view start = ":start...", end = ":end!";
+      const auto st = event.find(start);
+      const auto afterStart = st == std::string_view::npos ? st : st + start.size();
+      if (st != std::string_view::npos && (afterStart == event.size() || event.substr(afterStart, 2) == " (")) {
+        // "func:start... (a=1, b=2)"
+        auto args = event.substr(afterStart);
+        if (args.size() > 3) args = args.substr(2, args.size() - 3);
+        r.enter(thread, us, std::string(event.substr(0, st)), file, std::string(args), count);
+      } else if (event.size() > end.size() && event.substr(event.size() - end.size()) == end) {
+        r.exit(thread, us, event.substr(0, event.size() - end.size()), count);
+      } else {
+        // "func:msg": the scope is the thread's innermost one
+        const auto *t = r.thread(thread);
+        std::string_view msg = event;
+        if (t && !t->scopes.empty() && event.rfind(t->scopes.back().func + ":", 0) == 0)
+          msg.remove_prefix(t->scopes.back().func.size() + 1);
+        r.here(thread, us, msg, count);
+      }
+    }
+
+    inline void replayText(ScopeReplay &r, std::string_view data) {
+      const char *p = data.data();
+      const char *end = p + data.size();
+      while (p < end) {
+        const auto *nl = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char *eol = nl ? nl : end;
+        std::string_view line(p, static_cast<size_t>(eol - p));
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        replayTextLine(r, line);
+        p = eol + 1;
+      }
+    }
+
+    inline void replayBinary(ScopeReplay &r, std::string_view data) {
+      diag::Reader rd(data);
+      diag::Event ev;
+      while (rd.next(ev)) {
+        if (ev.type == diag::Session || (ev.type == diag::Text && ev.text.rfind("## CRASH POINT ##", 0) == 0)) {
+          r.reset();
+          continue;
+        }
+        if (ev.type == diag::Text) {
+          r.time(ev.timeUs);
+          continue;
+        }
+        const auto *site = rd.site(ev.site);
+        std::string func = site ? site->func : std::string("?");
+        if (!ev.name.empty()) func.append(":").append(ev.name);
+        const int count = static_cast<int>(ev.depth);
+        if (ev.type == diag::Enter) {
+          r.enter(ev.thread, ev.timeUs, std::move(func), site ? site->file : std::string_view("?"),
+            ev.args.empty() ? std::string() : formatScopeArgs(site ? site->args : std::string_view(), ev.args), count);
+        }
+        else if (ev.type == diag::Exit) r.exit(ev.thread, ev.timeUs, func, count);
+        else r.here(ev.thread, ev.timeUs, ev.text, count);
+      }
+    }
+
+    inline std::string formatElapsed(int64_t us) {
+      char buf[32];
+      if (us < 1000) std::snprintf(buf, sizeof(buf), "%lldus", static_cast<long long>(us));
+      else if (us < 1000000) std::snprintf(buf, sizeof(buf), "%.1fms", us / 1e3);
+      else std::snprintf(buf, sizeof(buf), "%.1fs", us / 1e6);
+      return buf;
+    }
+
+    // The tail of a text or binary image from its last session: the last
+    // binary session header or "## CRASH POINT ##" line within `window` bytes
+    // of the end. A text tail without one starts at a line boundary; binary
+    // records cannot be resynced, so a binary image without a header in the
+    // window is kept whole (files are rotated well below the window).
+    inline std::string_view lastSession(std::string_view image, size_t window) {
+      if (image.size() <= window && !diag::isBinary(image)) return image;
+      const size_t lo = image.size() > window ? image.size() - window : 0;
+      const auto tail = image.substr(lo);
+      if (diag::isBinary(image)) {
+        const std::string_view mark(diag::magic, sizeof(diag::magic));
+        for (auto at = tail.rfind(mark); at != std::string_view::npos; at = at ? tail.rfind(mark, at - 1) : std::string_view::npos) {
+          // a header is followed by a known version; anything else is payload
+          const auto v = at + mark.size() < tail.size() ? static_cast<uint8_t>(tail[at + mark.size()]) : 0;
+          if (v >= 1 && v <= diag::version) return tail.substr(at);
+        }
+        return image;
+      }
+      constexpr std::string_view crash = "\n## CRASH POINT ##";
+      const auto at = tail.rfind(crash);
+      if (at != std::string_view::npos) return tail.substr(at + 1);
+      if (lo == 0) return image;
+      const auto nl = tail.find('\n');
+      return nl == std::string_view::npos ? std::string_view() : tail.substr(nl + 1);
+    }
+
+  } // namespace impl
+
+  inline CrashAnalysis analyzeDiagnostics(std::string_view image) {
+    impl::ScopeReplay r;
+    if (diag::isRing(image)) {
+      const auto text = diag::unrollRing(image);
+      impl::replayText(r, text);
+    } else if (diag::isBinary(image)) {
+      impl::replayBinary(r, image);
+    } else {
+      impl::replayText(r, image);
+    }
+    return r.finish();
+  }
+
+  // Only the last session is replayed, found by looking back from the end at
+  // most `window` bytes; a ring is replayed whole (it has a fixed size).
+  inline CrashAnalysis analyzeDiagnosticsFile(const std::string &fname, size_t window = 4 * 1024 * 1024) {
+    impl::MappedFile f(fname);
+    const auto image = f.view();
+    return analyzeDiagnostics(diag::isRing(image) ? image : impl::lastSession(image, window));
+  }
+
+  // One line per thread, then its (at most maxScopes) open scopes innermost
+  // first with the time spent in them and their last LOG_HERE checkpoint.
+  inline std::string crashSummary(const CrashAnalysis &a, size_t maxScopes = 16) {
+    std::string out = "## CRASH SUMMARY ## last record [" + diag::formatTime(a.lastUs) + "], "
+      + std::to_string(a.threads.size()) + " thread(s) with open scopes";
+    for (const auto &t : a.threads) {
+      out += "\n  t" + std::to_string(t.thread) + ": " + std::to_string(t.scopes.size()) + " open, last record "
+        + impl::formatElapsed(a.lastUs - t.lastUs) + " before the end";
+      size_t shown = 0;
+      for (auto it = t.scopes.rbegin(); it != t.scopes.rend(); ++it) {
+        if (shown++ == maxScopes) {
+          out += "\n    ... +" + std::to_string(t.scopes.size() - maxScopes);
+          break;
+        }
+        out += "\n    " + it->func + (it->args.empty() ? "" : " (" + it->args + ")") + " " + it->file + " (" + impl::formatElapsed(a.lastUs - it->enterUs) + ")";
+        if (!it->lastHere.empty())
+          out += " last here \"" + it->lastHere + "\" " + impl::formatElapsed(a.lastUs - it->lastHereUs) + " before the end";
+      }
+    }
+    return out;
+  }
+
+} // namespace utils_log
@@ -0,0 +1,94 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define UTILS_LOG_CRC32C_X86 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define UTILS_LOG_CRC32C_ARM 1
+#endif
+
+
+namespace utils_log::impl {
+
+  // CRC32C (Castagnoli). Uses the SSE4.2 / ARMv8 crc32c instructions when
+  // available, a table driven fallback otherwise.
+
+  inline constexpr std::array<uint32_t, 256> crc32cTable() {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+      t[i] = c;
+    }
+    return t;
+  }
+
+  inline uint32_t crc32cSoftware(uint32_t crc, const unsigned char *p, size_t n) {
+    static constexpr auto table = crc32cTable();
+    for (size_t i = 0; i < n; ++i)
+      crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+  }
+
+#if defined(UTILS_LOG_CRC32C_X86)
+#if defined(__GNUC__) || defined(__clang__)
+  __attribute__((target("sse4.2")))
+#endif
+  inline uint32_t crc32cHardware(uint32_t crc, const unsigned char *p, size_t n) {
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+      uint64_t v;
+      std::memcpy(&v, p, 8);
+      c = _mm_crc32_u64(c, v);
+    }
+    auto c32 = static_cast<uint32_t>(c);
+    for (; n; --n, ++p) c32 = _mm_crc32_u8(c32, *p);
+    return c32;
+  }
+
+  inline bool crc32cHardwareSupported() {
+#if defined(__SSE4_2__)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+  }
+#elif defined(UTILS_LOG_CRC32C_ARM)
+  inline uint32_t crc32cHardware(uint32_t crc, const unsigned char *p, size_t n) {
+    for (; n >= 8; n -= 8, p += 8) {
+      uint64_t v;
+      std::memcpy(&v, p, 8);
+      crc = __crc32cd(crc, v);
+    }
+    for (; n; --n, ++p) crc = __crc32cb(crc, *p);
+    return crc;
+  }
+
+  inline bool crc32cHardwareSupported() { return true; }
+#endif
+
+  inline uint32_t crc32c(const void *data, size_t n, uint32_t crc = 0) {
+    const auto p = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+#if defined(UTILS_LOG_CRC32C_X86) || defined(UTILS_LOG_CRC32C_ARM)
+    static const bool hw = crc32cHardwareSupported();
+    if (hw) return ~crc32cHardware(crc, p, n);
+#endif
+    return ~crc32cSoftware(crc, p, n);
+  }
+
+} // namespace utils_log::impl
@@ -0,0 +1,285 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "scope_args.hpp"
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                      Binary diagnostics.log format
+  // ============================================================================
+  // A file is a sequence of sessions, one per process run:
+  //
+  //   Session   magic "ULDG" version(2) base-time(varint, us since epoch)
+  //   SiteDef   id line func file args       once per LOG_START site and session (no args in version 1)
+  //   Enter     dt site thread depth [name] [args]  dt: zigzag varint us since the previous record
+  //   Exit      dt site thread depth [name]
+  //   Here      dt site thread depth [name] msg
+  //   Text      dt text                      free-form lines (crash marks, fatal reports)
+  //
+  // Each record starts with a type byte; typeNamed (0x80) means a LOG_START1
+  // name follows, typeArgs (0x40) the raw LOG_START_ARGS bytes (scope_args.hpp).
+  // Strings are a varint length followed by the bytes.
+  namespace diag {
+
+    enum Type : uint8_t { Session = 1, SiteDef = 2, Enter = 3, Exit = 4, Here = 5, Text = 6 };
+    inline constexpr uint8_t typeNamed = 0x80;
+    inline constexpr uint8_t typeArgs = 0x40;
+    inline constexpr char magic[4] = { 'U', 'L', 'D', 'G' };
+    inline constexpr uint8_t version = 2;
+
+    inline void putVarint(std::string &out, uint64_t v) {
+      while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+      }
+      out.push_back(static_cast<char>(v));
+    }
+
+    inline void putSigned(std::string &out, int64_t v) {
+      putVarint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+    inline void putString(std::string &out, std::string_view s) {
+      putVarint(out, s.size());
+      out.append(s.data(), s.size());
+    }
+
+    inline bool isBinary(std::string_view head) {
+      return head.size() >= sizeof(magic) && head.substr(0, sizeof(magic)) == std::string_view(magic, sizeof(magic));
+    }
+
+    struct Event {
+      Type type{};
+      int64_t timeUs = 0;    // absolute, us since epoch
+      uint32_t site = 0;
+      uint32_t thread = 0;
+      uint32_t depth = 0;
+      std::string_view name; // LOG_START1 name, empty otherwise
+      std::string_view text; // Here message / Text line
+      std::string_view args; // raw LOG_START_ARGS bytes of an Enter
+    };
+
+    struct Site {
+      std::string func;
+      std::string file;
+      std::string args; // LOG_START_ARGS argument expressions
+      uint32_t line = 0;
+    };
+
+    // Sequential reader over an in-memory binary diagnostics image.
+    class Reader {
+    public:
+      explicit Reader(std::string_view data) : data_(data) {}
+
+      // False at the end or on a truncated/corrupt record (see truncated()).
+      bool next(Event &ev) {
+        while (pos_ < data_.size()) {
+          const size_t start = pos_;
+          if (data_.substr(pos_, sizeof(magic)) == std::string_view(magic, sizeof(magic))) {
+            pos_ += sizeof(magic);
+            uint64_t base = 0;
+            if (!getByte(version_) || !getVarint(base)) return fail(start);
+            sites_.clear();
+            now_ = static_cast<int64_t>(base);
+            ev = Event{};
+            ev.type = Session;
+            ev.timeUs = now_;
+            return true;
+          }
+          uint8_t tb = 0;
+          if (!getByte(tb)) return fail(start);
+          const auto type = static_cast<Type>(tb & ~(typeNamed | typeArgs));
+          if (type == SiteDef) {
+            uint64_t id = 0, line = 0;
+            std::string_view func, file, args;
+            if (!getVarint(id) || !getVarint(line) || !getString(func) || !getString(file)) return fail(start);
+            if (version_ >= 2 && !getString(args)) return fail(start);
+            sites_[static_cast<uint32_t>(id)] = Site{ std::string(func), std::string(file), std::string(args), static_cast<uint32_t>(line) };
+            continue;
+          }
+          int64_t dt = 0;
+          if (!getSigned(dt)) return fail(start);
+          now_ = static_cast<int64_t>(static_cast<uint64_t>(now_) + static_cast<uint64_t>(dt)); // wraps on corrupt input
+          ev = Event{};
+          ev.type = type;
+          ev.timeUs = now_;
+          if (type == Text) {
+            if (!getString(ev.text)) return fail(start);
+            return true;
+          }
+          if (type != Enter && type != Exit && type != Here) return fail(start);
+          uint64_t site = 0, thread = 0, depth = 0;
+          if (!getVarint(site) || !getVarint(thread) || !getVarint(depth)) return fail(start);
+          ev.site = static_cast<uint32_t>(site);
+          ev.thread = static_cast<uint32_t>(thread);
+          ev.depth = static_cast<uint32_t>(depth);
+          if ((tb & typeNamed) && !getString(ev.name)) return fail(start);
+          if ((tb & typeArgs) && !getString(ev.args)) return fail(start);
+          if (type == Here && !getString(ev.text)) return fail(start);
+          return true;
+        }
+        return false;
+      }
+
+      const Site *site(uint32_t id) const {
+        const auto it = sites_.find(id);
+        return it == sites_.end() ? nullptr : &it->second;
+      }
+
+      bool truncated() const { return truncated_; }
+
+    private:
+      std::string_view data_;
+      size_t pos_ = 0;
+      uint8_t version_ = version;
+      int64_t now_ = 0;
+      bool truncated_ = false;
+      std::unordered_map<uint32_t, Site> sites_;
+
+      bool fail(size_t start) {
+        pos_ = start;
+        truncated_ = true;
+        return false;
+      }
+
+      bool getByte(uint8_t &b) {
+        if (pos_ >= data_.size()) return false;
+        b = static_cast<uint8_t>(data_[pos_++]);
+        return true;
+      }
+
+      bool getVarint(uint64_t &v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+          uint8_t b = 0;
+          if (!getByte(b)) return false;
+          v |= static_cast<uint64_t>(b & 0x7F) << shift;
+          if (!(b & 0x80)) return true;
+        }
+        return false;
+      }
+
+      bool getSigned(int64_t &v) {
+        uint64_t u = 0;
+        if (!getVarint(u)) return false;
+        v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+        return true;
+      }
+
+      bool getString(std::string_view &s) {
+        uint64_t n = 0;
+        if (!getVarint(n) || n > data_.size() - pos_) return false;
+        s = data_.substr(pos_, static_cast<size_t>(n));
+        pos_ += static_cast<size_t>(n);
+        return true;
+      }
+    };
+
+    inline std::string formatTime(int64_t timeUs) {
+      auto t = static_cast<std::time_t>(timeUs / 1000000);
+      if (timeUs < 0 && timeUs % 1000000) --t;
+      std::tm tm{};
+#ifdef _WIN32
+      localtime_s(&tm, &t);
+#else
+      localtime_r(&t, &tm);
+#endif
+      char buf[32];
+      const auto n = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+      return std::string(buf, n);
+    }
+
+    // The text line ScopeLogger writes in text mode for the same event.
+    inline std::string toText(const Reader &r, const Event &ev) {
+      if (ev.type == Text) return std::string(ev.text);
+      const Site *s = r.site(ev.site);
+      std::string out = "[" + formatTime(ev.timeUs) + "] t" + std::to_string(ev.thread) + " " + (s ? s->func : std::string("?"));
+      if (!ev.name.empty()) out.append(":").append(ev.name);
+      out += ':';
+      if (ev.type == Enter) {
+        out += "start...";
+        if (!ev.args.empty()) out += " (" + formatScopeArgs(s ? s->args : std::string_view(), ev.args) + ")";
+      }
+      else if (ev.type == Exit) out += "end!";
+      else out.append(ev.text);
+      out += " " + (s ? s->file : std::string("?")) + " |" + std::to_string(ev.depth);
+      return out;
+    }
+
+  } // namespace diag
+
+  // ============================================================================
+  //                      Circular diagnostics.log image
+  // ============================================================================
+  // A ring file is a RingHeader page followed by `capacity` data bytes written
+  // circularly (text records only). head is the next write offset, wraps counts
+  // how often it went past the end; the oldest data starts at head once wraps > 0.
+  namespace diag {
+
+    struct RingHeader {
+      char magic[4];
+      uint32_t version;
+      uint64_t capacity;
+      uint64_t head;
+      uint64_t wraps;
+    };
+
+    inline constexpr char ringMagic[4] = { 'U', 'L', 'R', 'G' };
+    inline constexpr size_t ringHeaderSize = 4096;
+
+    inline bool isRing(std::string_view image) {
+      return image.size() >= sizeof(RingHeader) && image.substr(0, sizeof(ringMagic)) == std::string_view(ringMagic, sizeof(ringMagic));
+    }
+
+    // The ring's records in write order; after a wrap the oldest, partly
+    // overwritten line is dropped. Empty if the image is inconsistent.
+    inline std::string unrollRing(std::string_view image) {
+      RingHeader h;
+      std::memcpy(&h, image.data(), sizeof(h));
+      if (h.capacity == 0 || h.head >= h.capacity || image.size() < ringHeaderSize + h.capacity) return {};
+      const auto data = image.substr(ringHeaderSize, static_cast<size_t>(h.capacity));
+      const auto head = static_cast<size_t>(h.head);
+      if (!h.wraps) return std::string(data.substr(0, head));
+
+      std::string out(data.substr(head));
+      out.append(data.substr(0, head));
+      const auto nl = out.find('\n');
+      return nl == std::string::npos ? std::string() : out.substr(nl + 1);
+    }
+
+  } // namespace diag
+
+  // Writes a binary or circular diagnostics.log as plain text (text files are
+  // copied); returns false if the file cannot be read or ends in a truncated record.
+  inline bool decodeDiagnostics(const std::string &fname, std::ostream &os) {
+    std::ifstream ifs(fname, std::ios::binary);
+    if (!ifs.is_open()) return false;
+    const std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (diag::isRing(data)) {
+      os << diag::unrollRing(data);
+      return true;
+    }
+    if (!diag::isBinary(data)) {
+      os << data;
+      return true;
+    }
+    diag::Reader r(data);
+    diag::Event ev;
+    while (r.next(ev)) {
+      if (ev.type != diag::Session) os << diag::toText(r, ev) << '\n';
+    }
+    return !r.truncated();
+  }
+
+} // namespace utils_log
@@ -0,0 +1,223 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <atomic>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+
+namespace utils_log {
+
+  namespace impl {
+    // Containers print at most this many elements, then "... +N".
+    inline std::atomic<size_t> maxLoggedElements{ 64 };
+  }
+
+#define SET_LOG_MAX_ELEMENTS(x) utils_log::impl::maxLoggedElements = (x)
+
+  // ============================================================================
+  //                                RecordBuffer
+  // ============================================================================
+  // Text of the record being built by Log. Values are rendered straight into it.
+  class RecordBuffer {
+  public:
+    void reserve(size_t n) { s_.reserve(n); }
+    void append(std::string_view sv) { s_.append(sv.data(), sv.size()); }
+    void append(char c) { s_.push_back(c); }
+
+    template <typename Int>
+    void appendInt(Int v) {
+      using U = std::make_unsigned_t<Int>;
+      char buf[24];
+      char *p = buf + sizeof(buf);
+      U u = static_cast<U>(v);
+      if constexpr (std::is_signed_v<Int>) {
+        if (v < 0) u = static_cast<U>(U(0) - u);
+      }
+      do {
+        *--p = static_cast<char>('0' + u % 10);
+        u = static_cast<U>(u / 10);
+      } while (u);
+      if constexpr (std::is_signed_v<Int>) {
+        if (v < 0) *--p = '-';
+      }
+      s_.append(p, static_cast<size_t>(buf + sizeof(buf) - p));
+    }
+
+    void appendFloat(double v);
+
+    bool empty() const { return s_.empty(); }
+    size_t size() const { return s_.size(); }
+    std::string_view view() const { return s_; }
+    std::string take() { std::string r = std::move(s_); s_.clear(); return r; }
+    void clear() { s_.clear(); }
+
+  private:
+    std::string s_;
+  };
+
+  // ============================================================================
+  //                                formatter<T>
+  // ============================================================================
+  // Customization point for user types; takes precedence over operator<<:
+  //
+  //   template <> struct utils_log::formatter<Point> {
+  //     static void format(utils_log::RecordBuffer &buf, const Point &p) {
+  //       buf.append('(');
+  //       utils_log::formatTo(buf, p.x);
+  //       ...
+  //     }
+  //   };
+  template <typename T, typename = void>
+  struct formatter {};
+
+  template <typename T> void formatTo(RecordBuffer &buf, const T &val);
+
+  namespace impl {
+
+    template <typename T, typename = void> struct hasFormatter : std::false_type {};
+    template <typename T>
+    struct hasFormatter<T, std::void_t<decltype(formatter<T>::format(std::declval<RecordBuffer &>(), std::declval<const T &>()))>>
+      : std::true_type {};
+
+    template <typename T, typename = void> struct isTupleLike : std::false_type {};
+    template <typename T> struct isTupleLike<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+    template <typename T, typename = void> struct isRange : std::false_type {};
+    template <typename T>
+    struct isRange<T, std::void_t<decltype(std::begin(std::declval<const T &>())), decltype(std::end(std::declval<const T &>()))>>
+      : std::true_type {};
+
+    template <typename T, typename = void> struct isMapLike : std::false_type {};
+    template <typename T>
+    struct isMapLike<T, std::void_t<typename T::key_type, typename T::mapped_type>> : std::true_type {};
+
+    template <typename T, typename = void> struct isSetLike : std::false_type {};
+    template <typename T>
+    struct isSetLike<T, std::void_t<typename T::key_type>> : std::bool_constant<!isMapLike<T>::value> {};
+
+    template <typename T, typename = void> struct hasSize : std::false_type {};
+    template <typename T>
+    struct hasSize<T, std::void_t<decltype(std::size(std::declval<const T &>()))>> : std::true_type {};
+
+    template <typename T, typename = void> struct isStreamable : std::false_type {};
+    template <typename T>
+    struct isStreamable<T, std::void_t<decltype(std::declval<std::ostream &>() << std::declval<const T &>())>> : std::true_type {};
+
+    template <typename T>
+    inline constexpr bool isStringLike = std::is_convertible_v<const T &, std::string_view>;
+
+    template <typename T>
+    inline constexpr bool isCharType = std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>;
+
+    // Thread-local std::ostringstream kept in the backend.
+    std::ostream &streamedBegin();
+    void streamedEnd(std::ostream &os, RecordBuffer &buf);
+
+    // Renders through operator<<(std::ostream&) for types without a direct formatter.
+    template <typename T>
+    void formatStreamed(RecordBuffer &buf, const T &val) {
+      auto &os = streamedBegin();
+      os << val;
+      streamedEnd(os, buf);
+    }
+
+    template <typename T> void formatValue(RecordBuffer &buf, const T &val);
+
+    // Element of a composite value: strings and characters are quoted.
+    template <typename T>
+    void formatElement(RecordBuffer &buf, const T &val) {
+      if constexpr (isCharType<T>) {
+        buf.append('\'');
+        buf.append(static_cast<char>(val));
+        buf.append('\'');
+      } else if constexpr (isStringLike<T>) {
+        buf.append('"');
+        formatValue(buf, val);
+        buf.append('"');
+      } else {
+        formatValue(buf, val);
+      }
+    }
+
+    template <typename T, size_t... I>
+    void formatTuple(RecordBuffer &buf, const T &val, std::index_sequence<I...>) {
+      using std::get;
+      buf.append('(');
+      ((buf.append(I == 0 ? "" : ", "), formatElement(buf, get<I>(val))), ...);
+      buf.append(')');
+    }
+
+    template <typename T>
+    void formatRange(RecordBuffer &buf, const T &range) {
+      constexpr bool isMap = isMapLike<T>::value;
+      buf.append(isMap || isSetLike<T>::value ? '{' : '[');
+      const size_t limit = maxLoggedElements.load(std::memory_order_relaxed);
+      size_t n = 0;
+      auto it = std::begin(range);
+      const auto end = std::end(range);
+      for (; it != end && n < limit; ++it, ++n) {
+        if (n) buf.append(", ");
+        if constexpr (isMap) {
+          formatElement(buf, it->first);
+          buf.append(": ");
+          formatElement(buf, it->second);
+        } else {
+          formatElement(buf, *it);
+        }
+      }
+      if (it != end) {
+        buf.append(n ? ", ..." : "...");
+        if constexpr (hasSize<T>::value) {
+          buf.append(" +");
+          buf.appendInt(static_cast<size_t>(std::size(range)) - n);
+        }
+      }
+      buf.append(isMap || isSetLike<T>::value ? '}' : ']');
+    }
+
+    // formatter<T> specializations first (format_std.hpp adds the standard
+    // library vocabulary types), then builtins, pairs and tuples; other types
+    // use their operator<<, and ranges without one are listed element by element.
+    template <typename T>
+    void formatValue(RecordBuffer &buf, const T &val) {
+      if constexpr (hasFormatter<T>::value) {
+        formatter<T>::format(buf, val);
+      } else if constexpr (std::is_same_v<T, bool>) {
+        buf.append(val ? '1' : '0');
+      } else if constexpr (isCharType<T>) {
+        buf.append(static_cast<char>(val));
+      } else if constexpr (std::is_integral_v<T>) {
+        buf.appendInt(val);
+      } else if constexpr (std::is_floating_point_v<T>) {
+        buf.appendFloat(static_cast<double>(val));
+      } else if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>) {
+        if (val) buf.append(std::string_view(val));
+        else buf.append("(null)");
+      } else if constexpr (isStringLike<T>) {
+        buf.append(std::string_view(val));
+      } else if constexpr (isTupleLike<T>::value && !isRange<T>::value) {
+        formatTuple(buf, val, std::make_index_sequence<std::tuple_size<T>::value>{});
+      } else if constexpr (isStreamable<T>::value) {
+        formatStreamed(buf, val);
+      } else if constexpr (isRange<T>::value) {
+        formatRange(buf, val);
+      } else {
+        static_assert(isStreamable<T>::value, "utils_log: type has no operator<<(std::ostream&) and is not a range");
+      }
+    }
+
+    using FormatFn = void (*)(RecordBuffer &, const void *);
+
+    template <typename T>
+    void formatErased(RecordBuffer &buf, const void *val) { formatValue(buf, *static_cast<const T *>(val)); }
+
+  } // namespace impl
+
+  // Renders a value the way Log does; for use inside formatter<T>::format.
+  template <typename T>
+  void formatTo(RecordBuffer &buf, const T &val) { impl::formatValue(buf, val); }
+
+} // namespace utils_log
@@ -0,0 +1,93 @@
+// Author: Arman Sahakyan
+#pragma once
+// formatter<T> specializations for std::optional, std::variant and std::chrono.
+// Included by logger.hpp; TUs that include only log.hpp add it when they log these types.
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <optional>
+#include <ratio>
+#include <variant>
+
+#include "format.hpp"
+
+
+namespace utils_log {
+
+  template <typename T>
+  struct formatter<std::optional<T>> {
+    static void format(RecordBuffer &buf, const std::optional<T> &val) {
+      if (val) formatTo(buf, *val);
+      else buf.append("nullopt");
+    }
+  };
+
+  template <typename... Ts>
+  struct formatter<std::variant<Ts...>> {
+    static void format(RecordBuffer &buf, const std::variant<Ts...> &val) {
+      if (val.valueless_by_exception()) buf.append("valueless");
+      else std::visit([&buf](const auto &v) { formatTo(buf, v); }, val);
+    }
+  };
+
+  template <>
+  struct formatter<std::monostate> {
+    static void format(RecordBuffer &buf, std::monostate) { buf.append("monostate"); }
+  };
+
+  template <typename Rep, typename Period>
+  struct formatter<std::chrono::duration<Rep, Period>> {
+    static void format(RecordBuffer &buf, const std::chrono::duration<Rep, Period> &d) {
+      if constexpr (std::is_floating_point_v<Rep>) buf.appendFloat(static_cast<double>(d.count()));
+      else buf.appendInt(d.count());
+      using P = typename Period::type;
+      if constexpr (std::is_same_v<P, std::nano>) buf.append("ns");
+      else if constexpr (std::is_same_v<P, std::micro>) buf.append("us");
+      else if constexpr (std::is_same_v<P, std::milli>) buf.append("ms");
+      else if constexpr (std::is_same_v<P, std::ratio<1>>) buf.append('s');
+      else if constexpr (std::is_same_v<P, std::ratio<60>>) buf.append("min");
+      else if constexpr (std::is_same_v<P, std::ratio<3600>>) buf.append('h');
+      else if constexpr (std::is_same_v<P, std::ratio<86400>>) buf.append('d');
+      else {
+        buf.append('[');
+        buf.appendInt(P::num);
+        if constexpr (P::den != 1) {
+          buf.append('/');
+          buf.appendInt(P::den);
+        }
+        buf.append("]s");
+      }
+    }
+  };
+
+  template <typename Clock, typename Dur>
+  struct formatter<std::chrono::time_point<Clock, Dur>> {
+    static void format(RecordBuffer &buf, const std::chrono::time_point<Clock, Dur> &tp) {
+      using namespace std::chrono;
+      if constexpr (std::is_same_v<Clock, system_clock>) {
+        const auto secs = time_point_cast<seconds>(tp);
+        auto frac = duration_cast<milliseconds>(tp - secs).count();
+        auto t = system_clock::to_time_t(secs);
+        if (frac < 0) {
+          frac += 1000;
+          --t;
+        }
+        std::tm tm{};
+#ifdef _WIN32
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        char out[40];
+        const auto n = std::strftime(out, sizeof(out), "%Y-%m-%d %H:%M:%S", &tm);
+        buf.append(std::string_view(out, n));
+        std::snprintf(out, sizeof(out), ".%03d", static_cast<int>(frac));
+        buf.append(out);
+      } else {
+        formatTo(buf, tp.time_since_epoch());
+        buf.append(" since epoch");
+      }
+    }
+  };
+
+} // namespace utils_log
@@ -0,0 +1,95 @@
+// Author: Arman Sahakyan
+#pragma once
+#ifdef UTILS_LOG_ZLIB
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+
+namespace utils_log::impl {
+
+  // ============================================================================
+  //                     GzipFrameWriter (compressed output.log)
+  // ============================================================================
+  // Writes a file as a sequence of independent gzip members ("frames"), so the
+  // result is readable with zcat / gzip -d. Every write() ends with a
+  // Z_SYNC_FLUSH and a file flush: after a crash the current frame is still
+  // decodable up to its last complete record, and every earlier frame is intact.
+  // A frame is finished after frameBytes of uncompressed input, which bounds
+  // how much history a decoder needs and how much a damaged frame can take down.
+  class GzipFrameWriter {
+  public:
+    GzipFrameWriter() = default;
+    GzipFrameWriter(const GzipFrameWriter &) = delete;
+    GzipFrameWriter &operator=(const GzipFrameWriter &) = delete;
+    ~GzipFrameWriter() { close(); }
+
+    bool open(const std::string &fname, size_t frameBytes, int level = Z_DEFAULT_COMPRESSION) {
+      close();
+      frameBytes_ = frameBytes ? frameBytes : 1;
+      out_.open(fname, std::ios::app | std::ios::binary);
+      if (!out_.is_open()) return false;
+      // windowBits 15 + 16: gzip wrapper
+      if (deflateInit2(&zs_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        out_.close();
+        return false;
+      }
+      zinit_ = true;
+      frameIn_ = 0;
+      return true;
+    }
+
+    bool is_open() const { return zinit_ && out_.is_open(); }
+    bool good() const { return is_open() && out_.good(); }
+
+    void write(std::string_view data) {
+      if (!good()) return;
+      zs_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+      zs_.avail_in = static_cast<uInt>(data.size());
+      frameIn_ += data.size();
+      if (frameIn_ >= frameBytes_) {
+        deflateAll(Z_FINISH);
+        deflateReset(&zs_);
+        frameIn_ = 0;
+      } else {
+        deflateAll(Z_SYNC_FLUSH);
+      }
+      out_.flush();
+    }
+
+    void close() {
+      if (zinit_) {
+        if (out_.good() && frameIn_ > 0) {
+          zs_.next_in = nullptr;
+          zs_.avail_in = 0;
+          deflateAll(Z_FINISH);
+        }
+        deflateEnd(&zs_);
+        zinit_ = false;
+      }
+      if (out_.is_open()) out_.close();
+    }
+
+  private:
+    std::ofstream out_;
+    z_stream zs_{};
+    bool zinit_ = false;
+    size_t frameBytes_ = 1;
+    size_t frameIn_ = 0;
+
+    void deflateAll(int flush) {
+      char buf[16 * 1024];
+      int rc;
+      do {
+        zs_.next_out = reinterpret_cast<Bytef *>(buf);
+        zs_.avail_out = sizeof(buf);
+        rc = deflate(&zs_, flush);
+        out_.write(buf, static_cast<std::streamsize>(sizeof(buf) - zs_.avail_out));
+      } while (zs_.avail_out == 0 || (flush == Z_FINISH && rc == Z_OK));
+    }
+  };
+
+} // namespace utils_log::impl
+#endif // UTILS_LOG_ZLIB
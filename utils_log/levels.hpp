@@ -0,0 +1,12 @@
+// Author: Arman Sahakyan
+#pragma once
+
+
+namespace utils_log {
+
+  enum class Level : int { Trace, Debug, Info, Warning, Error, Fatal, Off };
+
+  // As written in output.log records, by Level; readers (search.hpp, tools) parse the same names.
+  inline constexpr const char *levelNames[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "OFF" };
+
+} // namespace utils_log
@@ -0,0 +1,676 @@
+// Author: Arman Sahakyan
+#pragma once
+// Front-end: macros, the record builder and settings, without the sinks.
+// Header-only by default; define UTILS_LOG_COMPILED_LIB in every TU and
+// compile utils_log/logger.cpp once to keep the backend out of the TUs that log.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ios>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "format.hpp"
+#include "levels.hpp"
+#include "scope_args.hpp"
+
+#ifdef UTILS_LOG_COMPILED_LIB
+#define UTILS_LOG_INLINE
+#else
+#define UTILS_LOG_INLINE inline
+#endif
+
+// UTILS_LOG_COLD / UTILS_LOG_NOINLINE go on definitions, UTILS_LOG_COLD_DECL on
+// their declarations (gcc rejects an inline definition after a noinline declaration).
+#if defined(__GNUC__) || defined(__clang__)
+#define UTILS_LOG_NOINLINE __attribute__((noinline))
+#define UTILS_LOG_COLD __attribute__((cold, noinline))
+#define UTILS_LOG_COLD_DECL __attribute__((cold))
+#define UTILS_LOG_LIKELY(x) __builtin_expect(!!(x), 1)
+#elif defined(_MSC_VER)
+#define UTILS_LOG_NOINLINE __declspec(noinline)
+#define UTILS_LOG_COLD __declspec(noinline)
+#define UTILS_LOG_COLD_DECL __declspec(noinline)
+#define UTILS_LOG_LIKELY(x) (!!(x))
+#else
+#define UTILS_LOG_NOINLINE
+#define UTILS_LOG_COLD
+#define UTILS_LOG_COLD_DECL
+#define UTILS_LOG_LIKELY(x) (!!(x))
+#endif
+
+
+namespace utils_log {
+
+  //template <typename... Args>
+  //std::string strf(Args&&... args) {
+  //  std::ostringstream oss;
+  //  (oss << ... << std::forward<Args>(args));
+  //  return oss.str();
+  //}
+
+  namespace impl {
+    inline std::string outputFilePath = "output.log";
+    inline std::string diagnosticsFilePath = "diagnostics.log";
+    // Non-empty: the covered LOG_START sites are merged into this file at exit.
+    inline std::string coverageFilePath;
+    // Non-empty: the metrics are also written here in the Prometheus text format.
+    inline std::string metricsFilePath;
+
+    inline std::atomic_bool logToFile{ true };
+    inline std::atomic_bool logToConsole{ true };
+  }
+
+  class Redactor;
+
+  // Record sequence numbers written to output.log, for loss detection.
+  // Global: one counter for the process (" seq=N"), PerThread: one per thread (" tseq=N").
+  enum class SequenceMode { None, Global, PerThread };
+
+  namespace impl {
+    inline std::atomic<SequenceMode> sequenceMode{ SequenceMode::None };
+    // Appends " crc=XXXXXXXX" (CRC32C of everything before it) to every output.log record.
+    inline std::atomic_bool logChecksum{ false };
+    // Write diagnostics.log in the binary format of diag_format.hpp (read at
+    // first file open); tools/diag_decode.cpp turns it back into text.
+    inline std::atomic_bool diagnosticsBinary{ false };
+    // Non-zero: diagnostics.log is a memory-mapped ring of this many bytes
+    // (text records; read at first file open, overrides diagnosticsBinary).
+    inline std::atomic<size_t> diagnosticsRingBytes{ 0 };
+    // A scope that directly re-enters its own site is not written; the
+    // outermost one logs a summary ("recursion: entered xN ...") instead.
+    inline std::atomic_bool collapseRecursion{ true };
+    // Off: no scope records; scope stacks, coverage and profiling still work.
+    inline std::atomic_bool diagnosticsEnabled{ true };
+    // Scope profiling: per-site calls, wall time and CPU counters (perf_counters.hpp).
+    inline std::atomic_bool scopeProfiling{ false };
+    // Non-zero: every output.log segment gets a Bloom filter of its message
+    // tokens of this many bits in "<segment>.bloom" (read at first file open).
+    inline std::atomic<uint64_t> bloomBits{ 0 };
+    inline std::atomic<uint32_t> bloomMinToken{ 4 };
+    // Also write the records column by column to outputFilePath + ".col"
+    // (columnar.hpp; read at first file open).
+    inline std::atomic_bool columnarOutput{ false };
+    // Count records and bytes per LOG_* site and per message shape.
+    inline std::atomic_bool volumeAccounting{ false };
+    // Non-null: applied to every record before it reaches a sink (redact.hpp).
+    inline std::atomic<const Redactor *> redactor{ nullptr };
+
+#ifdef UTILS_LOG_ZLIB
+    // Write output.log as gzip frames to outputFilePath + ".gz" (read at first file open).
+    inline std::atomic_bool logCompression{ false };
+    inline std::atomic<size_t> compressionFrameBytes{ 1024 * 1024 };
+#endif
+  }
+
+  // ============================================================================
+  //                                Levels
+  // ============================================================================
+  // enum class Level: levels.hpp
+  namespace impl {
+    inline std::atomic<int> logLevel{ static_cast<int>(Level::Info) };
+    // Per-thread override; Off means none. Can only lower the threshold.
+    inline thread_local int threadLevel = static_cast<int>(Level::Off);
+    // Raised above logLevel while the logger is over its budget (SET_LOG_BUDGET);
+    // Trace means not throttled.
+    inline std::atomic<int> throttleLevel{ static_cast<int>(Level::Trace) };
+    // Budget of the logger's own cost: wall time spent in Log::commit() (waits
+    // for the file mutex and the disk included) as percent of the window, and
+    // bytes per second written to output.log. 0: no limit.
+    inline std::atomic<double> budgetTimePercent{ 0 };
+    inline std::atomic<uint64_t> budgetBytesPerSec{ 0 };
+  }
+
+  namespace impl {
+    // A record isEnabled() passed over only because of the throttle; lets the
+    // budget see quiet windows while nothing below the throttle is committed.
+    void throttledOut();
+  }
+
+  // A record is written when its level reaches the global level or the
+  // calling thread's override, whichever is lower, and the throttle level:
+  // one threshold, compared once.
+  inline bool isEnabled(Level level) {
+    const int l = static_cast<int>(level);
+    const int global = impl::logLevel.load(std::memory_order_relaxed);
+    const int local = impl::threadLevel;
+    const int throttle = impl::throttleLevel.load(std::memory_order_relaxed);
+    const int base = local < global ? local : global;
+    if (UTILS_LOG_LIKELY(l >= (base > throttle ? base : throttle))) return true;
+    if (l >= base) impl::throttledOut();
+    return false;
+  }
+
+  inline Level threadLevelOverride() { return static_cast<Level>(impl::threadLevel); }
+
+  // Sets the calling thread's level override for the guard's lifetime.
+  class LogLevelOverride {
+  public:
+    explicit LogLevelOverride(Level level) : prev_(impl::threadLevel) {
+      impl::threadLevel = static_cast<int>(level);
+    }
+    ~LogLevelOverride() { impl::threadLevel = prev_; }
+
+    LogLevelOverride(const LogLevelOverride &) = delete;
+    LogLevelOverride &operator=(const LogLevelOverride &) = delete;
+
+  private:
+    int prev_;
+  };
+
+  // Wraps a task so that it runs with the calling thread's current override.
+  template <typename F>
+  auto bindLogLevel(F &&f) {
+    return [level = threadLevelOverride(), f = std::forward<F>(f)](auto &&...args) mutable -> decltype(auto) {
+      LogLevelOverride guard(level);
+      return f(std::forward<decltype(args)>(args)...);
+    };
+  }
+
+  namespace impl {
+    // Records at or above this level get " bt=module+0xoff,..." (raw return
+    // addresses, symbolized offline by tools/log_symbolize.cpp).
+    inline std::atomic<int> stackTraceLevel{ static_cast<int>(Level::Off) };
+  }
+
+#define SET_LOG_LEVEL(x) utils_log::impl::logLevel = static_cast<int>(x)
+#define SET_LOG_STACK_TRACE(x) utils_log::impl::stackTraceLevel = static_cast<int>(x)
+#define SET_LOG_BUDGET(timePercent, bytesPerSec) \
+  (utils_log::impl::budgetTimePercent = (timePercent), utils_log::impl::budgetBytesPerSec = (bytesPerSec))
+#define LOG_LEVEL_OVERRIDE(x) utils_log::LogLevelOverride _loglevel_(x)
+
+#define SET_LOG_OUTPUT_FILE_PATH(x) utils_log::impl::outputFilePath = (x)
+#define SET_LOG_DIAGNOSTICS_FILE_PATH(x) utils_log::impl::diagnosticsFilePath = (x)
+#define SET_LOG_COVERAGE_FILE_PATH(x) utils_log::impl::coverageFilePath = (x)
+#define SET_LOG_METRICS_FILE_PATH(x) utils_log::impl::metricsFilePath = (x)
+#define SET_LOG_METRICS_INTERVAL_MS(x) utils_log::impl::metricsIntervalMs = (x)
+
+#define SET_LOG_TO_FILE(x) utils_log::impl::logToFile = (x)
+#define SET_LOG_TO_CONSOLE(x) utils_log::impl::logToConsole = (x)
+#define SET_LOG_SEQUENCE(x) utils_log::impl::sequenceMode = (x)
+#define SET_LOG_CHECKSUM(x) utils_log::impl::logChecksum = (x)
+#define SET_LOG_DIAGNOSTICS_BINARY(x) utils_log::impl::diagnosticsBinary = (x)
+#define SET_LOG_DIAGNOSTICS_RING(bytes) utils_log::impl::diagnosticsRingBytes = (bytes)
+#define SET_LOG_COLLAPSE_RECURSION(x) utils_log::impl::collapseRecursion = (x)
+#define SET_LOG_DIAGNOSTICS(x) utils_log::impl::diagnosticsEnabled = (x)
+#define SET_LOG_SCOPE_PROFILING(x) utils_log::impl::scopeProfiling = (x)
+#define SET_LOG_REDACTION(x) utils_log::impl::redactor = (x)
+#define SET_LOG_BLOOM_FILTER(bits) utils_log::impl::bloomBits = (bits)
+#define SET_LOG_BLOOM_MIN_TOKEN(x) utils_log::impl::bloomMinToken = (x)
+#define SET_LOG_COLUMNAR(x) utils_log::impl::columnarOutput = (x)
+#define SET_LOG_VOLUME_ACCOUNTING(x) utils_log::impl::volumeAccounting = (x)
+#ifdef UTILS_LOG_ZLIB
+#define SET_LOG_COMPRESSION(x) utils_log::impl::logCompression = (x)
+#define SET_LOG_COMPRESSION_FRAME_BYTES(x) utils_log::impl::compressionFrameBytes = (x)
+#endif
+
+  namespace impl {
+    // One per LOG_* statement, constant-initialized (UTILS_LOG_SITE).
+    struct LogSite {
+      const char *file;
+      int line;
+      std::atomic<uint32_t> volumeId{ 0 }; // log volume accounting, assigned on first record
+    };
+  }
+
+  // "Top N sites by bytes" of what was written to output.log since start,
+  // then the heaviest message shapes (SET_LOG_VOLUME_ACCOUNTING).
+  std::string logVolumeReport(size_t top = 20);
+
+#define UTILS_LOG_SITE ([]() -> utils_log::impl::LogSite & { static utils_log::impl::LogSite site_{ __FILE__, __LINE__ }; return site_; }())
+
+  // ============================================================================
+  //                                Log
+  // ============================================================================
+  // The builder is kept out of line: a call site inlines the level check and
+  // calls to the cold constructor, the non-template put*() appenders and the
+  // destructor. Types without a put*() overload go through one type-erased
+  // entry point with a per-type formatting thunk.
+  class Log {
+  public:
+    struct NospaceTag {};
+    struct SpaceTag {};
+
+  public:
+    UTILS_LOG_COLD_DECL Log();
+    UTILS_LOG_COLD_DECL explicit Log(Level level);
+    UTILS_LOG_COLD_DECL Log(bool toFile, bool toConsole = impl::logToConsole.load());
+    UTILS_LOG_COLD_DECL Log(Level level, bool toFile, bool toConsole = impl::logToConsole.load());
+
+    // Defined here: gcc drops noinline from an out-of-class destructor definition.
+    UTILS_LOG_NOINLINE ~Log() { commit(); }
+
+    Log(const Log &) = delete;
+    Log &operator=(const Log &) = delete;
+
+    template <typename T>
+    Log &operator<<(const T &val) {
+      if constexpr (impl::hasFormatter<T>::value) {
+        putErased(&val, &impl::formatErased<T>);
+      } else if constexpr (std::is_same_v<T, bool>) {
+        putChar(val ? '1' : '0');
+      } else if constexpr (impl::isCharType<T>) {
+        putChar(static_cast<char>(val));
+      } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        putInt(static_cast<long long>(val));
+      } else if constexpr (std::is_integral_v<T>) {
+        putUInt(static_cast<unsigned long long>(val));
+      } else if constexpr (std::is_floating_point_v<T>) {
+        putFloat(static_cast<double>(val));
+      } else if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>) {
+        putCStr(val);
+      } else if constexpr (impl::isStringLike<T>) {
+        put(std::string_view(val));
+      } else {
+        putErased(&val, &impl::formatErased<T>);
+      }
+      return *this;
+    }
+
+    Log &operator<<(std::string_view sv) {
+      put(sv);
+      return *this;
+    }
+
+    // std::hex, std::fixed, std::uppercase, ... apply to the numbers and
+    // streamed values after them in the record; std::endl appends a newline.
+    // std::setw, std::setprecision, ... only reach the value they are streamed
+    // into, which prints nothing.
+    Log &operator<<(std::ios_base &(*manip)(std::ios_base &)) {
+      putManip(manip);
+      return *this;
+    }
+
+    Log &operator<<(std::ostream &(*manip)(std::ostream &)) {
+      putManip(manip);
+      return *this;
+    }
+
+    Log &operator<<(Log::NospaceTag) {
+      noSpace_ = true;
+      return *this;
+    }
+
+    Log &operator<<(Log::SpaceTag) {
+      noSpace_ = false;
+      return *this;
+    }
+
+    Log &noquote() { return *this; }
+
+    Log &at(impl::LogSite &site) {
+      site_ = &site;
+      return *this;
+    }
+
+    void commit();
+
+    // Closes the output file. Sinks reopen on the next record.
+    static void terminate();
+
+  protected:
+    std::string_view text() const { return buf_.view(); }
+
+  private:
+    bool toFile_;
+    bool toConsole_;
+    Level level_ = Level::Info;
+    bool hasLog_ = false;
+    bool noSpace_ = false;
+    RecordBuffer buf_;
+    impl::LogSite *site_ = nullptr;
+    std::ios *format_ = nullptr; // set by the first std::ios_base manipulator
+
+    void put(std::string_view sv);
+    void putCStr(const char *s);
+    void putChar(char c);
+    void putInt(long long v);
+    void putUInt(unsigned long long v);
+    void putFloat(double v);
+    void putErased(const void *val, impl::FormatFn fmt);
+    void putManip(std::ios_base &(*manip)(std::ios_base &));
+    void putManip(std::ostream &(*manip)(std::ostream &));
+    void separate() {
+      if (hasLog_ && !noSpace_) buf_.append(' ');
+      hasLog_ = true;
+    }
+  };
+
+inline constexpr Log::NospaceTag LOGNOSPACE{};
+inline constexpr Log::SpaceTag LOGSPACE{};
+
+#define LOG_NOSPACE utils_log::LOGNOSPACE
+#define LOG_SPACE utils_log::LOGSPACE
+
+#define UTILS_LOG_IF_ENABLED(lvl) if (!utils_log::isEnabled(lvl)) {} else
+
+#define LOG_MSG UTILS_LOG_IF_ENABLED(utils_log::Level::Info) utils_log::Log().at(UTILS_LOG_SITE)
+#define LOG_MSGNF UTILS_LOG_IF_ENABLED(utils_log::Level::Info) utils_log::Log(false).at(UTILS_LOG_SITE)
+
+#define LOG_TRACE UTILS_LOG_IF_ENABLED(utils_log::Level::Trace) utils_log::Log(utils_log::Level::Trace).at(UTILS_LOG_SITE)
+#define LOG_DEBUG UTILS_LOG_IF_ENABLED(utils_log::Level::Debug) utils_log::Log(utils_log::Level::Debug).at(UTILS_LOG_SITE)
+#define LOG_INFO UTILS_LOG_IF_ENABLED(utils_log::Level::Info) utils_log::Log(utils_log::Level::Info).at(UTILS_LOG_SITE)
+#define LOG_WARN UTILS_LOG_IF_ENABLED(utils_log::Level::Warning) utils_log::Log(utils_log::Level::Warning).at(UTILS_LOG_SITE)
+#define LOG_ERROR UTILS_LOG_IF_ENABLED(utils_log::Level::Error) utils_log::Log(utils_log::Level::Error).at(UTILS_LOG_SITE)
+
+
+  // ============================================================================
+  //                          TailBuffer (tail-based logging)
+  // ============================================================================
+  // Lowers the calling thread's level to `capture` for the guard's lifetime and
+  // keeps the records the level in effect before would have dropped in memory,
+  // up to maxBytes (the oldest go first). A record at `failAt` or above, or
+  // fail(), writes them out in order ahead of it; otherwise they are discarded
+  // with the guard. Nested buffers fail outward with such a record.
+  namespace impl {
+    struct LogRecord;
+    struct TailRecords;
+  }
+
+  class TailBuffer {
+  public:
+    explicit TailBuffer(Level capture = Level::Trace, Level failAt = Level::Error, size_t maxBytes = 256 * 1024);
+    ~TailBuffer();
+
+    TailBuffer(const TailBuffer &) = delete;
+    TailBuffer &operator=(const TailBuffer &) = delete;
+
+    // Writes what is held; records pass straight through from then on.
+    void fail();
+    bool failed() const { return failed_; }
+
+  private:
+    friend class Log;
+
+    Level failAt_;
+    size_t maxBytes_;
+    int prevLevel_;
+    TailBuffer *parent_;
+    impl::TailRecords *records_ = nullptr;
+    bool failed_ = false;
+
+    bool hold(impl::LogRecord &rec);
+  };
+
+  namespace impl {
+    inline thread_local TailBuffer *tailTop = nullptr;
+  }
+
+#define LOG_TAIL_BUFFER(x) utils_log::TailBuffer _logtail_(x)
+#define LOG_TAIL_FAIL() _logtail_.fail()
+
+
+  // ============================================================================
+  //                  Metrics (LOG_COUNT / LOG_GAUGE / LOG_HISTOGRAM)
+  // ============================================================================
+  // Updates are relaxed atomics on one of metricShards cache-line-sized shards,
+  // picked per thread; a reporter thread drains the shards every interval into
+  // one "metrics" record (and the Prometheus file). Names are string literals;
+  // sites with the same name share the metric.
+  namespace impl {
+    inline std::atomic<unsigned> metricsIntervalMs{ 10000 }; // 0: reportMetrics() only
+
+    enum class MetricKind { Counter, Gauge, Histogram };
+
+    inline constexpr int metricShards = 16;
+
+    // Histogram buckets: upper bounds 1, 2, 5 x 10^-6 .. 10^8, then +Inf.
+    inline constexpr int histogramBounds = 45;
+    inline constexpr int histogramSlots = histogramBounds + 1;
+
+    struct HistogramBounds {
+      double le[histogramBounds] = {};
+      constexpr HistogramBounds() {
+        double decade = 1e-6;
+        for (int i = 0; i < histogramBounds; i += 3, decade *= 10) {
+          le[i] = decade;
+          le[i + 1] = 2 * decade;
+          le[i + 2] = 5 * decade;
+        }
+      }
+    };
+    inline constexpr HistogramBounds histogramBound{};
+
+    inline int histogramSlot(double v) {
+      int lo = 0, hi = histogramBounds;
+      while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (v <= histogramBound.le[mid]) hi = mid;
+        else lo = mid + 1;
+      }
+      return lo;
+    }
+
+    inline int metricShard() {
+      static std::atomic<unsigned> next{ 0 };
+      thread_local const int shard = static_cast<int>(next.fetch_add(1, std::memory_order_relaxed) % metricShards);
+      return shard;
+    }
+
+    inline void atomicAdd(std::atomic<double> &a, double v) {
+      double cur = a.load(std::memory_order_relaxed);
+      while (!a.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed)) {}
+    }
+
+    inline void atomicMin(std::atomic<double> &a, double v) {
+      double cur = a.load(std::memory_order_relaxed);
+      while (v < cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+    }
+
+    inline void atomicMax(std::atomic<double> &a, double v) {
+      double cur = a.load(std::memory_order_relaxed);
+      while (v > cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+    }
+
+    struct alignas(64) MetricShard {
+      std::atomic<uint64_t> count{ 0 };
+      std::atomic<double> sum{ 0 };
+      std::atomic<double> min{ std::numeric_limits<double>::infinity() };
+      std::atomic<double> max{ -std::numeric_limits<double>::infinity() };
+      std::atomic<double> last{ 0 };      // gauges: last set() on this shard
+      std::atomic<int64_t> lastNs{ 0 };   // and its steady clock time, 0 before one
+    };
+
+    struct Metric {
+      const char *name;
+      MetricKind kind;
+      MetricShard shards[metricShards];
+      std::atomic<uint64_t> *buckets = nullptr; // histograms: metricShards x histogramSlots
+      // totals since start, kept by the reporter under the registry mutex
+      uint64_t totalCount = 0;
+      double totalSum = 0;
+      std::vector<uint64_t> totalBuckets;
+
+      Metric(const char *n, MetricKind k) : name(n), kind(k) {}
+
+      void add(uint64_t n) {
+        shards[metricShard()].count.fetch_add(n, std::memory_order_relaxed);
+      }
+
+      void set(double v) {
+        auto &s = shards[metricShard()];
+        s.last.store(v, std::memory_order_relaxed);
+        s.lastNs.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_release);
+        observe(v);
+      }
+
+      // Gauges: the latest set() of any shard.
+      double lastValue() const {
+        int64_t latest = 0;
+        double v = 0;
+        for (const auto &s : shards) {
+          const auto ns = s.lastNs.load(std::memory_order_acquire);
+          if (ns > latest) {
+            latest = ns;
+            v = s.last.load(std::memory_order_relaxed);
+          }
+        }
+        return v;
+      }
+
+      void observe(double v) {
+        const int shard = metricShard();
+        auto &s = shards[shard];
+        s.count.fetch_add(1, std::memory_order_relaxed);
+        atomicAdd(s.sum, v);
+        atomicMin(s.min, v);
+        atomicMax(s.max, v);
+        if (buckets) buckets[shard * histogramSlots + histogramSlot(v)].fetch_add(1, std::memory_order_relaxed);
+      }
+    };
+
+    // One per LOG_COUNT / LOG_GAUGE / LOG_HISTOGRAM site, constant-initialized.
+    struct MetricSite {
+      const char *name;
+      MetricKind kind;
+      std::atomic<Metric *> metric{ nullptr };
+    };
+
+    Metric &resolveMetric(MetricSite &site);
+
+    inline Metric &metric(MetricSite &site) {
+      if (auto *m = site.metric.load(std::memory_order_acquire)) return *m;
+      return resolveMetric(site);
+    }
+  }
+
+  // Writes the "metrics" record for the time since the last one (and the
+  // Prometheus file) now; the reporter thread calls it every interval.
+  void reportMetrics();
+
+#define UTILS_LOG_METRIC(kind, x) static utils_log::impl::MetricSite _metricsite_{ x, utils_log::impl::MetricKind::kind }
+#define LOG_COUNT(x) do { UTILS_LOG_METRIC(Counter, x); utils_log::impl::metric(_metricsite_).add(1); } while (0)
+#define LOG_COUNT_N(x, n) do { UTILS_LOG_METRIC(Counter, x); utils_log::impl::metric(_metricsite_).add(n); } while (0)
+#define LOG_GAUGE(x, v) do { UTILS_LOG_METRIC(Gauge, x); utils_log::impl::metric(_metricsite_).set(static_cast<double>(v)); } while (0)
+#define LOG_HISTOGRAM(x, v) do { UTILS_LOG_METRIC(Histogram, x); utils_log::impl::metric(_metricsite_).observe(static_cast<double>(v)); } while (0)
+
+
+  // ============================================================================
+  //                            ScopeLogger (diagnostics.log)
+  // ============================================================================
+  namespace impl {
+    struct ScopeStats;
+
+    // One per LOG_START site, constant-initialized.
+    struct ScopeSite {
+      const char *func;
+      const char *file;
+      int line;
+      const char *args = nullptr; // LOG_START_ARGS: the argument expressions
+      uint32_t id = 0; // binary diagnostics site id, 0 until first written; guarded by the diagnostics mutex
+      std::atomic<ScopeStats *> stats{ nullptr }; // per-site aggregates, created on first use
+      std::atomic_bool covered{ false }; // set on first entry
+      ScopeSite *nextCovered = nullptr;  // list of covered sites, newest first
+    };
+
+    enum class ScopeEvent { Enter, Exit, Here };
+
+    // Allocations of the innermost scope; counted by the operator new hooks
+    // of alloc_hooks.hpp, added to the site's stats when the scope ends.
+    struct AllocCounter {
+      uint64_t count = 0;
+      uint64_t bytes = 0;
+    };
+    inline thread_local AllocCounter *allocTarget = nullptr;
+
+    inline void countAllocation(size_t n) {
+      if (auto *c = allocTarget) {
+        c->count++;
+        c->bytes += n;
+      }
+    }
+  }
+
+  class ScopeLogger {
+  public:
+    explicit ScopeLogger(impl::ScopeSite &site);
+    ScopeLogger(impl::ScopeSite &site, std::string_view name);
+    ScopeLogger(impl::ScopeSite &site, const impl::ScopeArgs &args);
+    ~ScopeLogger();
+
+    ScopeLogger(const ScopeLogger &) = delete;
+    ScopeLogger &operator=(const ScopeLogger &) = delete;
+
+    void here(std::string_view msg) { log(impl::ScopeEvent::Here, msg); }
+
+    // Innermost scope of the calling thread; parent() walks outwards.
+    static const ScopeLogger *current();
+    const ScopeLogger *parent() const { return parent_; }
+    // "func" or "func:name" for LOG_START1 scopes
+    std::string func() const { return name_.empty() ? std::string(site_->func) : site_->func + (":" + name_); }
+    const std::string &name() const { return name_; }
+    // "a=1, s=\"abc\"" for LOG_START_ARGS scopes, empty otherwise
+    std::string args() const { return args_ ? formatScopeArgs(site_->args, args_->bytes()) : std::string(); }
+    const char *file() const { return site_->file; }
+    int line() const { return site_->line; }
+    // Outermost scope of a direct recursion this scope is collapsed into, or null.
+    const ScopeLogger *recursionRoot() const { return root_; }
+
+  private:
+    impl::ScopeSite *site_;
+    std::string name_;
+    const impl::ScopeArgs *args_ = nullptr;
+    ScopeLogger *parent_ = nullptr;
+    // Recursion collapsing: nested entries of the same site only count on the root.
+    ScopeLogger *root_ = nullptr;
+    uint32_t nested_ = 0;
+    uint32_t maxNested_ = 0;
+    uint32_t entered_ = 0;
+    // Scope profiling: counters at entry
+    bool profiled_ = false;
+    int64_t startNs_ = 0;
+    uint64_t counters_[4];
+    impl::AllocCounter allocs_;
+    impl::AllocCounter *prevAllocTarget_ = nullptr;
+
+    void enter();
+    void profileEnd();
+    void log(impl::ScopeEvent ev, std::string_view msg) const;
+  };
+
+  // Macros
+#define UTILS_LOG_SCOPE_SITE static utils_log::impl::ScopeSite _scopesite_{ __FUNCTION__, __FILE__, __LINE__ }
+#define LOG_START UTILS_LOG_SCOPE_SITE; utils_log::ScopeLogger _scopelog_(_scopesite_)
+#define LOG_START1(x) UTILS_LOG_SCOPE_SITE; utils_log::ScopeLogger _scopelog_(_scopesite_, x)
+// Captures the arguments as raw bytes (see scope_args.hpp); formatted only when written as text or dumped.
+#define LOG_START_ARGS(...) \
+  static utils_log::impl::ScopeSite _scopesite_{ __FUNCTION__, __FILE__, __LINE__, #__VA_ARGS__ }; \
+  const utils_log::impl::ScopeArgs _scopeargs_(__VA_ARGS__); \
+  utils_log::ScopeLogger _scopelog_(_scopesite_, _scopeargs_)
+#define LOG_HERE(x) _scopelog_.here(x)
+
+  // Per-site totals of SET_LOG_SCOPE_PROFILING(true), by wall time; one line per site.
+  std::string scopeProfileReport();
+  // Per-site heap allocations (alloc_hooks.hpp), by bytes; one line per site.
+  std::string scopeAllocationReport();
+  // "file:line func" of every LOG_START site entered so far, sorted.
+  std::vector<std::string> coveredScopes();
+  // Merges coveredScopes() into the lines of fname; false on I/O errors.
+  bool writeScopeCoverage(const std::string &fname);
+
+
+  // ============================================================================
+  //                            LOG_CHECK / LOG_FATAL
+  // ============================================================================
+  namespace impl {
+    // Failure record of LOG_CHECK / LOG_FATAL. Everything but the macros'
+    // condition test is out of line and cold; the destructor writes the
+    // record and the scope stack, flushes the sinks and aborts.
+    class FatalLog : public Log {
+    public:
+      UTILS_LOG_COLD_DECL FatalLog(const char *cond, const char *file, int line);
+      UTILS_LOG_COLD_DECL ~FatalLog();
+    };
+  }
+
+#define LOG_CHECK(cond) if (UTILS_LOG_LIKELY(cond)) {} else utils_log::impl::FatalLog(#cond, __FILE__, __LINE__)
+#define LOG_FATAL utils_log::impl::FatalLog(nullptr, __FILE__, __LINE__)
+
+} // namespace utils
+
+#ifndef UTILS_LOG_COMPILED_LIB
+#include "logger_impl.hpp"
+#endif
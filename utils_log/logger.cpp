@@ -0,0 +1,8 @@
+// Author: Arman Sahakyan
+// Backend translation unit for UTILS_LOG_COMPILED_LIB builds; compile it once
+// with the same UTILS_LOG_* definitions as the rest of the program.
+#ifndef UTILS_LOG_COMPILED_LIB
+#define UTILS_LOG_COMPILED_LIB
+#endif
+#include "log.hpp"
+#include "logger_impl.hpp"
@@ -0,0 +1,1607 @@
+// Author: Arman Sahakyan
+#pragma once
+// Backend: sinks, rotation and crash detection. Included by log.hpp in
+// header-only mode, compiled once by logger.cpp with UTILS_LOG_COMPILED_LIB.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <set>
+#include <thread>
+#include <atomic>
+//#include <format>
+#include <utility>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <vector>
+
+#include "log.hpp"
+#include "bloom.hpp"
+#include "columnar.hpp"
+#include "crc32c.hpp"
+#include "crash_analysis.hpp"
+#include "diag_format.hpp"
+#include "perf_counters.hpp"
+#include "redact.hpp"
+#include "ring_file.hpp"
+#include "gzip_writer.hpp"
+#include "stacktrace.hpp"
+
+#ifdef QT_CORE_LIB
+#include <QString>
+#include <QStringList>
+#include <QDebug>
+#endif // QT_CORE_LIB
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include "windows.h"
+#endif
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                              Shared helpers
+  // ============================================================================
+  namespace impl {
+
+    // The logger's own allocations are not charged to the scopes.
+    struct AllocCountPause {
+      AllocCounter *saved = std::exchange(allocTarget, nullptr);
+      ~AllocCountPause() { allocTarget = saved; }
+    };
+
+    // Format state of the record being written (Log::putManip), if any.
+    inline thread_local const std::ios *streamFormat = nullptr;
+
+    UTILS_LOG_INLINE std::ostream &streamedBegin() {
+      thread_local std::ostringstream oss;
+      oss.str({});
+      oss.clear();
+      // a streamed value may leave manipulators behind (std::hex, std::setfill, ...)
+      oss.flags(std::ios_base::dec | std::ios_base::skipws);
+      oss.width(0);
+      oss.fill(' ');
+      oss.precision(6);
+      if (streamFormat) oss.copyfmt(*streamFormat);
+      return oss;
+    }
+
+    UTILS_LOG_INLINE void streamedEnd(std::ostream &os, RecordBuffer &buf) {
+      buf.append(static_cast<std::ostringstream &>(os).str());
+    }
+
+    // Renders through the stream with the record's format state.
+    template <typename F>
+    void withStreamFormat(const std::ios *format, F &&f) {
+      struct Restore {
+        const std::ios *saved;
+        ~Restore() { streamFormat = saved; }
+      } restore{ std::exchange(streamFormat, format) };
+      f();
+    }
+
+    UTILS_LOG_INLINE int64_t nowUs() {
+      using namespace std::chrono;
+      return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    UTILS_LOG_INLINE int64_t steadyNs() {
+      using namespace std::chrono;
+      return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    UTILS_LOG_INLINE std::string dateTime() {
+      using namespace std::chrono;
+      const auto now = system_clock::now();
+      const auto t = system_clock::to_time_t(now);
+      std::tm tm{};
+#ifdef _WIN32
+      localtime_s(&tm, &t);
+#else
+      localtime_r(&t, &tm);
+#endif
+      std::ostringstream oss;
+      oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+      return oss.str();
+    }
+
+    UTILS_LOG_INLINE const char *levelName(Level level) {
+      const auto i = static_cast<int>(level);
+      return i >= 0 && i < static_cast<int>(Level::Off) ? levelNames[i] : levelNames[static_cast<int>(Level::Off)];
+    }
+
+    UTILS_LOG_INLINE void rotateIfTooLarge(const std::string &fname, uintmax_t maxSize) {
+      namespace fs = std::filesystem;
+      if (fs::exists(fname) && fs::file_size(fname) > maxSize) {
+        const auto backup = fname + ".old";
+        if (fs::exists(backup)) fs::remove(backup);
+        fs::rename(fname, backup);
+        // a Bloom sidecar (bloom.hpp) goes with its segment
+        std::error_code ec;
+        fs::remove(backup + ".bloom", ec);
+        if (fs::exists(fname + ".bloom", ec)) fs::rename(fname + ".bloom", backup + ".bloom", ec);
+      }
+    }
+
+  } // namespace impl
+
+  UTILS_LOG_INLINE void RecordBuffer::appendFloat(double v) {
+    // Same text as the default std::ostream formatting (%g, precision 6).
+    char buf[32];
+    const int n = std::snprintf(buf, sizeof(buf), "%g", v);
+    if (n > 0) s_.append(buf, static_cast<size_t>(n));
+  }
+
+  // ============================================================================
+  //                                Log
+  // ============================================================================
+  namespace impl {
+
+    // ------------------------------------------------------------------------
+    // Log volume accounting: records and bytes per site, in per-thread shards
+    // written only by their thread and merged by logVolumeReport().
+    struct VolumeCounts {
+      std::atomic<uint64_t> records{ 0 };
+      std::atomic<uint64_t> bytes{ 0 };
+    };
+
+    inline constexpr uint32_t volumeChunk = 256;
+    inline constexpr uint32_t volumeChunks = 256; // sites past volumeChunk * volumeChunks share id 0
+
+    struct VolumeShard {
+      std::atomic<VolumeCounts *> chunks[volumeChunks] = {};
+
+      ~VolumeShard() {
+        for (auto &c : chunks) delete[] c.load();
+      }
+
+      void add(uint32_t id, uint64_t records, uint64_t bytes) {
+        auto &slot = chunks[id / volumeChunk];
+        auto *c = slot.load(std::memory_order_relaxed);
+        if (!c) {
+          c = new VolumeCounts[volumeChunk];
+          slot.store(c, std::memory_order_release);
+        }
+        auto &e = c[id % volumeChunk];
+        e.records.store(e.records.load(std::memory_order_relaxed) + records, std::memory_order_relaxed);
+        e.bytes.store(e.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+      }
+    };
+
+    struct VolumeRegistry {
+      std::mutex mutex;
+      std::vector<LogSite *> sites{ nullptr }; // by id; 0: no site
+      std::vector<VolumeShard *> shards;
+      // Under mutex: counts of exited threads, and of records a thread writes
+      // after its shard is gone (from thread_local or static destructors).
+      VolumeShard retired;
+
+      void retire(VolumeShard *shard) {
+        std::scoped_lock lock(mutex);
+        for (uint32_t i = 0; i < volumeChunk * volumeChunks; ++i) {
+          const auto *c = shard->chunks[i / volumeChunk].load(std::memory_order_acquire);
+          if (!c) {
+            i += volumeChunk - 1;
+            continue;
+          }
+          retired.add(i, c[i % volumeChunk].records.load(std::memory_order_relaxed), c[i % volumeChunk].bytes.load(std::memory_order_relaxed));
+        }
+        shards.erase(std::remove(shards.begin(), shards.end(), shard), shards.end());
+        delete shard;
+      }
+    };
+
+    // Never destroyed: records are written from static destructors too.
+    UTILS_LOG_INLINE VolumeRegistry &volumeRegistry() {
+      static auto *r = new VolumeRegistry;
+      return *r;
+    }
+
+    // Trivially destructible, so still readable once the thread's owner is gone.
+    struct VolumeThread {
+      VolumeShard *shard = nullptr;
+      bool exited = false;
+    };
+    inline thread_local VolumeThread volumeThread;
+
+    UTILS_LOG_INLINE void startMetricsReporter(); // also writes volumeSummary() every interval
+    inline thread_local bool volumeSummaryRecord = false; // not counted itself
+
+    UTILS_LOG_INLINE void countVolume(uint32_t id, uint64_t bytes) {
+      auto &t = volumeThread;
+      if (!t.shard && !t.exited) {
+        struct Owner {
+          ~Owner() {
+            volumeRegistry().retire(std::exchange(volumeThread.shard, nullptr));
+            volumeThread.exited = true;
+          }
+        };
+        t.shard = new VolumeShard;
+        {
+          auto &r = volumeRegistry();
+          std::scoped_lock lock(r.mutex);
+          r.shards.push_back(t.shard);
+        }
+        thread_local Owner owner;
+        startMetricsReporter();
+      }
+      if (t.shard) {
+        t.shard->add(id, 1, bytes);
+        return;
+      }
+      auto &r = volumeRegistry();
+      std::scoped_lock lock(r.mutex);
+      r.retired.add(id, 1, bytes);
+    }
+
+    UTILS_LOG_INLINE uint32_t volumeId(LogSite *site) {
+      if (!site) return 0;
+      if (const auto id = site->volumeId.load(std::memory_order_relaxed)) return id;
+      auto &r = volumeRegistry();
+      std::scoped_lock lock(r.mutex);
+      if (const auto id = site->volumeId.load(std::memory_order_relaxed)) return id;
+      if (r.sites.size() >= volumeChunk * volumeChunks) return 0;
+      r.sites.push_back(site);
+      const auto id = static_cast<uint32_t>(r.sites.size() - 1);
+      site->volumeId.store(id, std::memory_order_relaxed);
+      return id;
+    }
+
+    // Count-min sketch of bytes per message shape (digits collapsed to '#'),
+    // with the heaviest shapes seen kept as candidates. Guarded by OutputFile::mutex.
+    class MessageSketch {
+    public:
+      static constexpr int depth = 4;
+      static constexpr size_t width = 4096;
+      static constexpr size_t candidates = 32;
+
+      struct Shape {
+        uint64_t hash;
+        uint64_t bytes; // estimate, an upper bound
+        std::string text;
+      };
+
+      void add(std::string_view msg, uint64_t bytes) {
+        if (cells_.empty()) cells_.assign(depth * width, 0);
+        std::string shape;
+        for (size_t i = 0; i < msg.size() && shape.size() < 80; ++i) {
+          if (msg[i] >= '0' && msg[i] <= '9') {
+            while (i + 1 < msg.size() && msg[i + 1] >= '0' && msg[i + 1] <= '9') ++i;
+            shape += '#';
+          } else {
+            shape += msg[i];
+          }
+        }
+        const auto h = tokenHash(shape);
+        uint64_t estimate = ~0ull;
+        for (int d = 0; d < depth; ++d) {
+          auto &cell = cells_[d * width + ((h & 0xffffffffull) + static_cast<uint64_t>(d) * ((h >> 32) | 1)) % width];
+          cell += bytes;
+          estimate = std::min(estimate, cell);
+        }
+
+        Shape *lightest = nullptr;
+        for (auto &c : top_) {
+          if (c.hash == h) {
+            c.bytes = estimate;
+            return;
+          }
+          if (!lightest || c.bytes < lightest->bytes) lightest = &c;
+        }
+        if (top_.size() < candidates) top_.push_back(Shape{ h, estimate, std::move(shape) });
+        else if (estimate > lightest->bytes) *lightest = Shape{ h, estimate, std::move(shape) };
+      }
+
+      std::vector<Shape> top() const { return top_; }
+
+    private:
+      std::vector<uint64_t> cells_;
+      std::vector<Shape> top_;
+    };
+
+    struct OutputFile {
+      std::mutex mutex;
+      std::ofstream fout;
+      bool initialized = false;
+      uint64_t globalSeq = 0;
+#ifdef UTILS_LOG_ZLIB
+      GzipFrameWriter gzout;
+      bool compressed = false;
+#endif
+      TokenBloom bloom;      // of the current segment; disabled when off or not covering it
+      std::string bloomFile; // the segment's name
+      std::ofstream colout;  // output.log.col
+      columnar::BlockWriter columns;
+      MessageSketch sketch;  // SET_LOG_VOLUME_ACCOUNTING
+
+      ~OutputFile() {
+        // the filter covers the segment's final size
+        fout.close();
+#ifdef UTILS_LOG_ZLIB
+        gzout.close();
+#endif
+        saveBloom();
+        flushColumns();
+      }
+
+      void flushColumns() {
+        if (!colout.is_open() || !columns.rows()) return;
+        std::string block;
+        columns.finish(block);
+        colout.write(block.data(), static_cast<std::streamsize>(block.size()));
+        colout.flush();
+      }
+
+      void saveBloom() {
+        if (!bloom.enabled()) return;
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(bloomFile, ec);
+        if (!ec) bloom.save(bloomFile + ".bloom", size);
+      }
+    };
+
+    UTILS_LOG_INLINE OutputFile &outputFile() {
+      static OutputFile f;
+      return f;
+    }
+
+    UTILS_LOG_INLINE uint64_t threadId() {
+      auto id = std::this_thread::get_id();
+      std::ostringstream oss;
+      oss << id;
+      return std::hash<std::string>{}(oss.str());
+    }
+
+    // Called with OutputFile::mutex held, so global sequence numbers follow file order.
+    UTILS_LOG_INLINE std::string fileRecord(OutputFile &of, const std::string &prefix, const std::string &quoted) {
+      std::string rec = prefix;
+      switch (sequenceMode.load(std::memory_order_relaxed)) {
+      case SequenceMode::Global:
+        rec += " seq=" + std::to_string(++of.globalSeq);
+        break;
+      case SequenceMode::PerThread: {
+        thread_local uint64_t threadSeq = 0;
+        rec += " tseq=" + std::to_string(++threadSeq);
+        break;
+      }
+      default:
+        break;
+      }
+      rec += quoted;
+      if (logChecksum.load(std::memory_order_relaxed)) {
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), " crc=%08x", crc32c(rec.data(), rec.size()));
+        rec += buf;
+      }
+      return rec;
+    }
+
+    UTILS_LOG_INLINE void writeRecord(OutputFile &of, const std::string &rec) {
+#ifdef UTILS_LOG_ZLIB
+      if (of.compressed) {
+        of.gzout.write(rec);
+        return;
+      }
+#endif
+      if (of.fout.good()) {
+        of.fout << rec;
+        of.fout.flush();
+      }
+    }
+
+    // Continues the segment's filter if its sidecar covers all of it; a
+    // segment with records the filter never saw gets none until it rotates.
+    UTILS_LOG_INLINE void openBloom(OutputFile &of, const std::string &fname) {
+      const auto bits = bloomBits.load(std::memory_order_relaxed);
+      if (!bits) return;
+      of.bloomFile = fname;
+      std::error_code ec;
+      const auto size = std::filesystem::file_size(fname, ec);
+      if (ec || size == 0) {
+        of.bloom.reset(bits, bloomMinToken.load(std::memory_order_relaxed));
+        return;
+      }
+      MappedFile sidecar(fname + ".bloom");
+      if (!of.bloom.load(sidecar.view(), size)) {
+        sidecar.close();
+        std::filesystem::remove(fname + ".bloom", ec);
+      }
+    }
+
+    UTILS_LOG_INLINE void openColumns(OutputFile &of) {
+      if (!columnarOutput.load(std::memory_order_relaxed)) return;
+      const auto fname = outputFilePath + ".col";
+      rotateIfTooLarge(fname, 5 * 1024 * 1024);
+      std::error_code ec;
+      if (std::filesystem::file_size(fname, ec) > 0) {
+        // a crash may have torn the last block: cut it before appending
+        size_t keep = 0;
+        {
+          MappedFile old(fname);
+          keep = columnar::completeSize(old.view());
+          if (keep == old.view().size()) keep = std::string_view::npos;
+        }
+        if (keep != std::string_view::npos) std::filesystem::resize_file(fname, keep, ec);
+      }
+      of.colout.open(fname, std::ios::app | std::ios::binary);
+      if (of.colout.is_open()) {
+        // every run starts with a file header
+        of.colout.write(columnar::fileMagic, sizeof(columnar::fileMagic));
+        of.colout.put(static_cast<char>(columnar::version));
+      }
+    }
+
+    UTILS_LOG_INLINE void ensureFileOpen(OutputFile &of) {
+#ifdef UTILS_LOG_ZLIB
+      if (!of.initialized) of.compressed = logCompression;
+      if (of.compressed) {
+        const std::string fname = outputFilePath + ".gz";
+        if (!of.initialized) {
+          rotateIfTooLarge(fname, 5 * 1024 * 1024);
+          openBloom(of, fname);
+          openColumns(of);
+          of.initialized = true;
+        }
+        if (!of.gzout.is_open()) of.gzout.open(fname, compressionFrameBytes);
+        return;
+      }
+#endif
+      const std::string &fname = outputFilePath;
+      if (!of.initialized) {
+        rotateIfTooLarge(fname, 5 * 1024 * 1024);
+        openBloom(of, fname);
+        openColumns(of);
+        of.fout.open(fname, std::ios::app);
+        of.initialized = true;
+      } else if (!of.fout.is_open()) {
+        of.fout.open(fname, std::ios::app);
+      }
+    }
+
+  } // namespace impl
+
+  UTILS_LOG_INLINE UTILS_LOG_COLD Log::Log()
+    : toFile_(impl::logToFile.load()), toConsole_(impl::logToConsole.load()) {
+    impl::AllocCountPause pause;
+    buf_.reserve(128);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_COLD Log::Log(Level level)
+    : toFile_(impl::logToFile.load()), toConsole_(impl::logToConsole.load()), level_(level) {
+    impl::AllocCountPause pause;
+    buf_.reserve(128);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_COLD Log::Log(bool toFile, bool toConsole)
+    : toFile_(toFile), toConsole_(toConsole) {
+    impl::AllocCountPause pause;
+    buf_.reserve(128);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_COLD Log::Log(Level level, bool toFile, bool toConsole)
+    : toFile_(toFile), toConsole_(toConsole), level_(level) {
+    impl::AllocCountPause pause;
+    buf_.reserve(128);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::put(std::string_view sv) {
+    impl::AllocCountPause pause;
+    separate();
+    buf_.append(sv);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putCStr(const char *s) {
+    impl::AllocCountPause pause;
+    separate();
+    buf_.append(s ? std::string_view(s) : std::string_view("(null)"));
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putChar(char c) {
+    impl::AllocCountPause pause;
+    separate();
+    buf_.append(c);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putInt(long long v) {
+    impl::AllocCountPause pause;
+    separate();
+    if (format_) impl::withStreamFormat(format_, [&] { impl::formatStreamed(buf_, v); });
+    else buf_.appendInt(v);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putUInt(unsigned long long v) {
+    impl::AllocCountPause pause;
+    separate();
+    if (format_) impl::withStreamFormat(format_, [&] { impl::formatStreamed(buf_, v); });
+    else buf_.appendInt(v);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putFloat(double v) {
+    impl::AllocCountPause pause;
+    separate();
+    if (format_) impl::withStreamFormat(format_, [&] { impl::formatStreamed(buf_, v); });
+    else buf_.appendFloat(v);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putErased(const void *val, impl::FormatFn fmt) {
+    impl::AllocCountPause pause;
+    separate();
+    if (format_) impl::withStreamFormat(format_, [&] { fmt(buf_, val); });
+    else fmt(buf_, val);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putManip(std::ios_base &(*manip)(std::ios_base &)) {
+    impl::AllocCountPause pause;
+    if (!format_) format_ = new std::ios(nullptr);
+    manip(*format_);
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::putManip(std::ostream &(*manip)(std::ostream &)) {
+    impl::AllocCountPause pause;
+    auto &os = impl::streamedBegin();
+    manip(os);
+    const auto out = static_cast<std::ostringstream &>(os).str(); // "\n" for std::endl, nothing for std::flush
+    if (out.empty()) return;
+    separate();
+    buf_.append(out);
+  }
+
+  namespace impl {
+    // ------------------------------------------------------------------------
+    // Log budget: the cost of the logger is measured over one-second windows;
+    // over budget raises throttleLevel one level (up to Warning), three windows
+    // under half the budget lower it one level again.
+    struct LogBudget {
+      static constexpr int64_t windowNs = 1000000000;
+      static constexpr int calmWindows = 3;
+
+      std::atomic<int64_t> windowStart{ 0 };
+      std::atomic<uint64_t> costNs{ 0 };
+      std::atomic<uint64_t> bytes{ 0 };
+      std::mutex mutex; // the window check
+      int calm = 0;
+    };
+
+    UTILS_LOG_INLINE LogBudget &logBudget() {
+      static LogBudget b;
+      return b;
+    }
+
+    UTILS_LOG_INLINE bool budgetEnabled() {
+      return budgetTimePercent.load(std::memory_order_relaxed) > 0 || budgetBytesPerSec.load(std::memory_order_relaxed);
+    }
+
+    // Ends the window once it is over; from commit() and from the calls the
+    // throttle turns away, so quiet windows are seen while nothing is committed.
+    UTILS_LOG_INLINE void checkLogBudget(int64_t now) {
+      auto &b = logBudget();
+      auto start = b.windowStart.load(std::memory_order_relaxed);
+      if (!start) {
+        b.windowStart.compare_exchange_strong(start, now);
+        return;
+      }
+      if (now - start < LogBudget::windowNs) return;
+
+      std::string change;
+      {
+        std::unique_lock lock(b.mutex, std::try_to_lock);
+        if (!lock || !b.windowStart.compare_exchange_strong(start, now)) return;
+        const double seconds = static_cast<double>(now - start) / 1e9;
+        const double time = static_cast<double>(b.costNs.exchange(0)) / 1e9 / seconds * 100;
+        const double bps = static_cast<double>(b.bytes.exchange(0)) / seconds;
+        const double timeBudget = budgetTimePercent.load(std::memory_order_relaxed);
+        const double bpsBudget = static_cast<double>(budgetBytesPerSec.load(std::memory_order_relaxed));
+        const bool over = (timeBudget > 0 && time > timeBudget) || (bpsBudget > 0 && bps > bpsBudget);
+        const bool under = !(timeBudget > 0 && time > timeBudget / 2) && !(bpsBudget > 0 && bps > bpsBudget / 2);
+
+        const int configured = logLevel.load(std::memory_order_relaxed);
+        const int throttled = throttleLevel.load(std::memory_order_relaxed);
+        const int effective = std::max(configured, throttled);
+        int next = throttled;
+        // an idle stretch counts as the quiet windows it spans
+        b.calm = under ? b.calm + static_cast<int>(std::clamp<int64_t>((now - start) / LogBudget::windowNs, 1, LogBudget::calmWindows)) : 0;
+        if (over && effective < static_cast<int>(Level::Warning)) {
+          next = effective + 1;
+        } else if (b.calm >= LogBudget::calmWindows && throttled > configured) {
+          next = throttled - 1 > configured ? throttled - 1 : static_cast<int>(Level::Trace);
+          b.calm = 0;
+        }
+        if (next == throttled) return;
+        throttleLevel.store(next, std::memory_order_relaxed);
+
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2) << "log budget: time " << time << '%';
+        if (timeBudget > 0) oss << " (budget " << timeBudget << "%)";
+        oss << std::setprecision(0) << ", " << bps << " B/s";
+        if (bpsBudget > 0) oss << " (budget " << bpsBudget << " B/s)";
+        oss << "; level " << levelName(static_cast<Level>(effective)) << " -> " << levelName(static_cast<Level>(std::max(configured, next)));
+        change = oss.str();
+      }
+      Log(Level::Warning, true, logToConsole.load()) << change;
+    }
+
+    // Called at the end of commit(), which started at startNs. Wall time, not
+    // CPU time: the thread CPU clock is a system call per record on Linux.
+    UTILS_LOG_INLINE void chargeLogBudget(int64_t startNs) {
+      const auto now = steadyNs();
+      logBudget().costNs.fetch_add(static_cast<uint64_t>(now - startNs), std::memory_order_relaxed);
+      checkLogBudget(now);
+    }
+
+    UTILS_LOG_INLINE UTILS_LOG_NOINLINE void throttledOut() {
+      thread_local uint32_t calls = 0;
+      if (++calls % 16 == 0) checkLogBudget(steadyNs()); // the clock, not every call
+    }
+
+    // A committed record; held by a TailBuffer or written right away.
+    struct LogRecord {
+      Level level;
+      bool toFile;
+      bool toConsole;
+      std::string prefix; // "[date] tid=N"
+      std::string quoted; // " LEVEL \"msg\"" and the stack trace
+      std::string msg;
+      int64_t timeUs;
+      uint64_t tid;
+      LogSite *site;       // null for records not from a LOG_* macro
+
+      size_t bytes() const { return prefix.size() + quoted.size() + msg.size(); }
+    };
+
+    // One record per line: line breaks in the message are written as "\n" and "\r".
+    UTILS_LOG_INLINE std::string escapeLineBreaks(const std::string &msg) {
+      if (msg.find_first_of("\r\n") == std::string::npos) return msg;
+      std::string out;
+      out.reserve(msg.size() + 8);
+      for (char c : msg) {
+        if (c == '\n') out += "\\n";
+        else if (c == '\r') out += "\\r";
+        else out += c;
+      }
+      return out;
+    }
+
+    UTILS_LOG_INLINE LogRecord makeLogRecord(Level level, bool toFile, bool toConsole, std::string msg, const std::string &trace, LogSite *site) {
+      //const auto line = std::format("[{}] tid={} {} \"{}\"", dateTime(), threadId(), levelName(level), msg);
+      const auto tid = threadId();
+      return LogRecord{ level, toFile, toConsole, "[" + dateTime() + "] tid=" + std::to_string(static_cast<unsigned long long>(tid)),
+        std::string(" ") + levelName(level) + " \"" + escapeLineBreaks(msg) + "\"" + trace, std::move(msg), nowUs(), tid, site };
+    }
+
+    UTILS_LOG_INLINE void writeLogRecord(const LogRecord &rec) {
+      auto &of = impl::outputFile();
+      std::scoped_lock lock(of.mutex);
+      if (rec.toFile) {
+        impl::ensureFileOpen(of);
+        const auto line = impl::fileRecord(of, rec.prefix, rec.quoted) + '\n';
+        impl::writeRecord(of, line);
+        if (budgetEnabled()) logBudget().bytes.fetch_add(line.size(), std::memory_order_relaxed);
+        if (volumeAccounting.load(std::memory_order_relaxed) && !volumeSummaryRecord) {
+          countVolume(volumeId(rec.site), line.size());
+          of.sketch.add(rec.msg, line.size());
+        }
+        if (of.bloom.enabled()) of.bloom.addTokens(rec.msg);
+        if (of.colout.is_open()) {
+          of.columns.add(rec.timeUs, rec.tid, static_cast<int>(rec.level), rec.site ? rec.site->file : nullptr,
+            rec.site ? rec.site->line : 0, rec.msg);
+          if (of.columns.rows() >= 4096 || of.columns.bytes() >= 1024 * 1024) of.flushColumns();
+        }
+      }
+
+      // Console log (always)
+#ifdef QT_CORE_LIB
+      if (rec.toConsole) {
+        qDebug().nospace().noquote() << (rec.prefix + rec.quoted).c_str();
+      }
+#else
+      if (rec.toConsole) {
+        std::cout << rec.msg << std::endl;
+#ifdef _MSC_VER
+        ::OutputDebugStringA((rec.msg + "\n").c_str());
+#endif // _MSC_VER
+      }
+#endif // QT_CORE_LIB
+    }
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_NOINLINE void Log::commit() {
+    impl::AllocCountPause pause;
+    delete std::exchange(format_, nullptr);
+    if (!hasLog_) return;
+    const auto startNs = impl::budgetEnabled() ? impl::steadyNs() : 0;
+    std::string msg = buf_.take();
+    hasLog_ = false;
+    if (const auto *r = impl::redactor.load(std::memory_order_acquire)) r->apply(msg);
+
+    std::string trace;
+    if (toFile_ && static_cast<int>(level_) >= impl::stackTraceLevel.load(std::memory_order_relaxed)) {
+      impl::StackTrace st;
+      st.capture(2); // commit(), ~Log()
+      trace = " bt=" + impl::moduleOffsets(st);
+    }
+
+    auto rec = impl::makeLogRecord(level_, toFile_, toConsole_, std::move(msg), trace, site_);
+    if (auto *tail = impl::tailTop; !tail || !tail->hold(rec)) impl::writeLogRecord(rec);
+    if (startNs) impl::chargeLogBudget(startNs);
+  }
+
+  UTILS_LOG_INLINE void Log::terminate() {
+    auto &of = impl::outputFile();
+    std::scoped_lock lock(of.mutex);
+    if (of.fout.is_open()) of.fout.close();
+#ifdef UTILS_LOG_ZLIB
+    of.gzout.close();
+#endif
+    of.saveBloom();
+    of.flushColumns();
+  }
+
+  namespace impl {
+    struct VolumeRow {
+      uint64_t records = 0;
+      uint64_t bytes = 0;
+      LogSite *site = nullptr;
+    };
+
+    // Totals since start; sites and message shapes by bytes, heaviest first.
+    struct VolumeSnapshot {
+      uint64_t records = 0;
+      uint64_t bytes = 0;
+      std::vector<VolumeRow> sites;
+      std::vector<MessageSketch::Shape> shapes;
+    };
+
+    UTILS_LOG_INLINE VolumeSnapshot volumeSnapshot() {
+      VolumeSnapshot v;
+      auto &r = volumeRegistry();
+      {
+        std::scoped_lock lock(r.mutex);
+        auto &rows = v.sites;
+        rows.resize(r.sites.size());
+        for (size_t i = 0; i < rows.size(); ++i) rows[i].site = r.sites[i];
+        auto merge = [&](const VolumeShard &shard) {
+          for (size_t i = 0; i < rows.size(); ++i) {
+            const auto *c = shard.chunks[i / volumeChunk].load(std::memory_order_acquire);
+            if (!c) continue;
+            rows[i].records += c[i % volumeChunk].records.load(std::memory_order_relaxed);
+            rows[i].bytes += c[i % volumeChunk].bytes.load(std::memory_order_relaxed);
+          }
+        };
+        for (const auto *shard : r.shards) merge(*shard);
+        merge(r.retired);
+      }
+      for (const auto &row : v.sites) {
+        v.records += row.records;
+        v.bytes += row.bytes;
+      }
+      v.sites.erase(std::remove_if(v.sites.begin(), v.sites.end(), [](const VolumeRow &row) { return row.records == 0; }), v.sites.end());
+      std::sort(v.sites.begin(), v.sites.end(), [](const VolumeRow &a, const VolumeRow &b) { return a.bytes > b.bytes; });
+      {
+        auto &of = outputFile();
+        std::scoped_lock lock(of.mutex);
+        v.shapes = of.sketch.top();
+      }
+      std::sort(v.shapes.begin(), v.shapes.end(), [](const auto &a, const auto &b) { return a.bytes > b.bytes; });
+      return v;
+    }
+
+    UTILS_LOG_INLINE std::string volumeSiteName(const VolumeRow &row) {
+      return row.site ? std::string(row.site->file) + ':' + std::to_string(row.site->line) : std::string("(no site)");
+    }
+
+    // One line for the metrics reporter: "log volume: N records, B bytes; top: a.cpp:8=B ...; shapes: ..."
+    UTILS_LOG_INLINE std::string volumeSummary(size_t top) {
+      const auto v = volumeSnapshot();
+      if (!v.records) return {};
+      auto out = "log volume: " + std::to_string(v.records) + " records, " + std::to_string(v.bytes) + " bytes; top:";
+      for (size_t i = 0; i < v.sites.size() && i < top; ++i) out += ' ' + volumeSiteName(v.sites[i]) + '=' + std::to_string(v.sites[i].bytes);
+      out += "; shapes:";
+      for (size_t i = 0; i < v.shapes.size() && i < top; ++i) out += " '" + v.shapes[i].text + "'~" + std::to_string(v.shapes[i].bytes);
+      return out;
+    }
+  } // namespace impl
+
+  UTILS_LOG_INLINE std::string logVolumeReport(size_t top) {
+    const auto v = impl::volumeSnapshot();
+    std::ostringstream oss;
+    oss << "log volume: " << v.records << " records, " << v.bytes << " bytes\n";
+    oss << "top sites by bytes (bytes records share site):\n";
+    for (size_t i = 0; i < v.sites.size() && i < top; ++i) {
+      const auto &row = v.sites[i];
+      oss << "  " << row.bytes << ' ' << row.records << ' ' << std::fixed << std::setprecision(1)
+        << (v.bytes ? 100.0 * static_cast<double>(row.bytes) / static_cast<double>(v.bytes) : 0.0) << std::defaultfloat << "% "
+        << impl::volumeSiteName(row) << '\n';
+    }
+    oss << "top message shapes (count-min estimate of bytes, shape):\n";
+    for (size_t i = 0; i < v.shapes.size() && i < top; ++i) oss << "  ~" << v.shapes[i].bytes << " \"" << v.shapes[i].text << "\"\n";
+    return oss.str();
+  }
+
+
+
+  // ============================================================================
+  //                          TailBuffer (tail-based logging)
+  // ============================================================================
+  namespace impl {
+    struct TailRecords {
+      std::deque<LogRecord> records;
+      size_t bytes = 0;
+      uint64_t dropped = 0;
+    };
+  }
+
+  UTILS_LOG_INLINE TailBuffer::TailBuffer(Level capture, Level failAt, size_t maxBytes)
+    : failAt_(failAt), maxBytes_(maxBytes), prevLevel_(impl::threadLevel), parent_(impl::tailTop) {
+    if (static_cast<int>(capture) < impl::threadLevel) impl::threadLevel = static_cast<int>(capture);
+    impl::tailTop = this;
+  }
+
+  UTILS_LOG_INLINE TailBuffer::~TailBuffer() {
+    impl::tailTop = parent_;
+    impl::threadLevel = prevLevel_;
+    delete records_;
+  }
+
+  UTILS_LOG_INLINE void TailBuffer::fail() {
+    failed_ = true;
+    if (!records_) return;
+    auto held = std::move(*records_);
+    delete records_;
+    records_ = nullptr;
+    if (held.dropped) {
+      impl::writeLogRecord(impl::makeLogRecord(Level::Warning, true, false,
+        "tail buffer: " + std::to_string(held.dropped) + " earlier record(s) dropped", {}, nullptr));
+    }
+    for (const auto &rec : held.records) impl::writeLogRecord(rec);
+  }
+
+  // True if the record is held here (or by an enclosing buffer).
+  UTILS_LOG_INLINE bool TailBuffer::hold(impl::LogRecord &rec) {
+    if (failed_) return false;
+    const int level = static_cast<int>(rec.level);
+    if (level >= static_cast<int>(failAt_)) {
+      // enclosing buffers failing too hold older records: they go first
+      if (parent_ && level >= static_cast<int>(parent_->failAt_)) parent_->hold(rec);
+      fail();
+      return false;
+    }
+    // written anyway: at the level in effect outside the buffer, throttle included
+    const int global = impl::logLevel.load(std::memory_order_relaxed);
+    const int throttle = impl::throttleLevel.load(std::memory_order_relaxed);
+    const int outside = prevLevel_ < global ? prevLevel_ : global;
+    if (level >= (outside > throttle ? outside : throttle)) return parent_ && parent_->hold(rec);
+
+    if (!records_) records_ = new impl::TailRecords;
+    records_->bytes += rec.bytes();
+    records_->records.push_back(std::move(rec));
+    while (records_->bytes > maxBytes_ && !records_->records.empty()) {
+      records_->bytes -= records_->records.front().bytes();
+      records_->records.pop_front();
+      records_->dropped++;
+    }
+    return true;
+  }
+
+
+  // ============================================================================
+  //                  Metrics (LOG_COUNT / LOG_GAUGE / LOG_HISTOGRAM)
+  // ============================================================================
+  namespace impl {
+    struct MetricRegistry;
+    UTILS_LOG_INLINE MetricRegistry &metricRegistry();
+
+    struct MetricRegistry {
+      std::mutex mutex;
+      std::vector<Metric *> list; // never freed: sites point at them
+      std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+
+      std::thread reporter;
+      std::mutex stopMutex;
+      std::condition_variable stopCv;
+      bool stop = false;
+      bool finished = false; // the final report is written; guarded by mutex
+
+      MetricRegistry() {
+        outputFile(); // constructed first: the final report at exit writes to it
+      }
+
+      // No report here: statics it would log through (the budget, a user's
+      // redactor) may already be gone. finish() writes it at exit.
+      ~MetricRegistry() { stopReporter(); }
+
+      void stopReporter() {
+        if (!reporter.joinable()) return;
+        {
+          std::scoped_lock lock(stopMutex);
+          stop = true;
+        }
+        stopCv.notify_one();
+        reporter.join();
+      }
+
+      void finish() {
+        {
+          std::scoped_lock lock(mutex);
+          finished = true;
+        }
+        stopReporter();
+        report();
+      }
+
+      void run() {
+        std::unique_lock lock(stopMutex);
+        while (!stop) {
+          const auto ms = metricsIntervalMs.load(std::memory_order_relaxed);
+          stopCv.wait_for(lock, std::chrono::milliseconds(ms ? ms : 1000), [this] { return stop; });
+          if (stop || !ms) continue;
+          lock.unlock();
+          report();
+          lock.lock();
+        }
+      }
+
+      void startReporter() {
+        std::scoped_lock lock(mutex);
+        startLocked();
+      }
+
+      // With the first metric: the reporter thread, and the final report as
+      // an at-exit hook. Registered after the statics the report uses are
+      // constructed, the hook runs before they are destroyed.
+      void startLocked() {
+        if (reporter.joinable() || finished) return;
+        logBudget();
+        reporter = std::thread([this] { run(); });
+        std::atexit([] { metricRegistry().finish(); });
+      }
+
+      void report();
+    };
+
+    UTILS_LOG_INLINE MetricRegistry &metricRegistry() {
+      static MetricRegistry r;
+      return r;
+    }
+
+    UTILS_LOG_INLINE void startMetricsReporter() {
+      metricRegistry().startReporter();
+    }
+
+    // Interval totals of one metric, drained from its shards.
+    struct MetricDrain {
+      uint64_t count = 0;
+      double sum = 0;
+      double min = std::numeric_limits<double>::infinity();
+      double max = -std::numeric_limits<double>::infinity();
+      uint64_t buckets[histogramSlots] = {};
+    };
+
+    UTILS_LOG_INLINE MetricDrain drainMetric(Metric &m) {
+      MetricDrain d;
+      for (int i = 0; i < metricShards; ++i) {
+        auto &s = m.shards[i];
+        d.count += s.count.exchange(0, std::memory_order_relaxed);
+        d.sum += s.sum.exchange(0, std::memory_order_relaxed);
+        d.min = std::min(d.min, s.min.exchange(std::numeric_limits<double>::infinity(), std::memory_order_relaxed));
+        d.max = std::max(d.max, s.max.exchange(-std::numeric_limits<double>::infinity(), std::memory_order_relaxed));
+        if (m.buckets) {
+          for (int b = 0; b < histogramSlots; ++b)
+            d.buckets[b] += m.buckets[i * histogramSlots + b].exchange(0, std::memory_order_relaxed);
+        }
+      }
+      return d;
+    }
+
+    UTILS_LOG_INLINE std::string formatMetricValue(double v) {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%g", v);
+      return buf;
+    }
+
+    // Upper bound of the bucket holding the q-th quantile.
+    UTILS_LOG_INLINE double histogramQuantile(const uint64_t *buckets, uint64_t count, double q, double max) {
+      const auto rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+      uint64_t seen = 0;
+      for (int b = 0; b < histogramBounds; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) return std::min(histogramBound.le[b], max);
+      }
+      return max;
+    }
+
+    // Metric names as Prometheus accepts them: [a-zA-Z_:][a-zA-Z0-9_:]*
+    UTILS_LOG_INLINE std::string prometheusName(const char *name) {
+      std::string out(name);
+      for (auto &c : out) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != ':') c = '_';
+      }
+      if (out.empty() || std::isdigit(static_cast<unsigned char>(out[0]))) out.insert(0, "_");
+      return out;
+    }
+
+    // One family per name: metrics are kept per (name, kind), so a name used
+    // with several kinds (or colliding once sanitized) gets its kind appended.
+    UTILS_LOG_INLINE std::string prometheusText(const std::vector<Metric *> &list) {
+      static constexpr const char *kindSuffix[] = { "_counter", "_gauge", "_histogram" };
+      std::string out;
+      std::set<std::string> names;
+      for (const auto *m : list) {
+        auto name = prometheusName(m->name);
+        while (!names.insert(name).second) name += kindSuffix[static_cast<int>(m->kind)];
+        switch (m->kind) {
+        case MetricKind::Counter:
+          out += "# TYPE " + name + " counter\n" + name + " " + std::to_string(m->totalCount) + "\n";
+          break;
+        case MetricKind::Gauge:
+          out += "# TYPE " + name + " gauge\n" + name + " " + formatMetricValue(m->lastValue()) + "\n";
+          break;
+        case MetricKind::Histogram: {
+          out += "# TYPE " + name + " histogram\n";
+          uint64_t cumulative = 0;
+          for (int b = 0; b < histogramSlots; ++b) {
+            cumulative += m->totalBuckets[b];
+            out += name + "_bucket{le=\"" + (b < histogramBounds ? formatMetricValue(histogramBound.le[b]) : "+Inf") + "\"} "
+              + std::to_string(cumulative) + "\n";
+          }
+          out += name + "_sum " + formatMetricValue(m->totalSum) + "\n" + name + "_count " + std::to_string(m->totalCount) + "\n";
+          break;
+        }
+        }
+      }
+      return out;
+    }
+
+    // "metrics 10.0s: requests=120 queue{last=3 min=0 max=17 avg=4.2} latency{n=120 avg=... p50<=... p99<=... max=...}"
+    UTILS_LOG_INLINE void MetricRegistry::report() {
+      std::string record, prom;
+      {
+        std::scoped_lock lock(mutex);
+        const auto now = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(now - lastReport).count();
+        lastReport = now;
+
+        for (auto *m : list) {
+          const auto d = drainMetric(*m);
+          m->totalCount += d.count;
+          m->totalSum += d.sum;
+          for (int b = 0; b < histogramSlots && m->buckets; ++b) m->totalBuckets[b] += d.buckets[b];
+          if (!d.count) continue;
+
+          record += ' ';
+          record += m->name;
+          if (m->kind == MetricKind::Counter) {
+            record += '=' + std::to_string(d.count);
+          } else if (m->kind == MetricKind::Gauge) {
+            record += "{last=" + formatMetricValue(m->lastValue()) + " min=" + formatMetricValue(d.min)
+              + " max=" + formatMetricValue(d.max) + " avg=" + formatMetricValue(d.sum / static_cast<double>(d.count)) + "}";
+          } else {
+            record += "{n=" + std::to_string(d.count) + " avg=" + formatMetricValue(d.sum / static_cast<double>(d.count))
+              + " min=" + formatMetricValue(d.min)
+              + " p50<=" + formatMetricValue(histogramQuantile(d.buckets, d.count, 0.50, d.max))
+              + " p90<=" + formatMetricValue(histogramQuantile(d.buckets, d.count, 0.90, d.max))
+              + " p99<=" + formatMetricValue(histogramQuantile(d.buckets, d.count, 0.99, d.max))
+              + " max=" + formatMetricValue(d.max) + "}";
+          }
+        }
+        if (!record.empty()) {
+          char buf[32];
+          std::snprintf(buf, sizeof(buf), "metrics %.1fs:", seconds);
+          record.insert(0, buf);
+        }
+        if (!metricsFilePath.empty()) prom = prometheusText(list);
+      }
+
+      // written whatever the level: one record per interval
+      if (!record.empty()) Log(Level::Info, true, false) << record;
+      if (volumeAccounting.load(std::memory_order_relaxed)) {
+        if (const auto volume = volumeSummary(5); !volume.empty()) {
+          volumeSummaryRecord = true;
+          Log(Level::Info, true, false) << volume;
+          volumeSummaryRecord = false;
+        }
+      }
+
+      if (!prom.empty()) {
+        // replaced whole, as the node_exporter textfile collector expects
+        const auto tmp = metricsFilePath + ".tmp";
+        {
+          std::ofstream ofs(tmp, std::ios::trunc);
+          ofs << prom;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, metricsFilePath, ec);
+      }
+    }
+
+    UTILS_LOG_INLINE Metric &resolveMetric(MetricSite &site) {
+      auto &r = metricRegistry();
+      std::scoped_lock lock(r.mutex);
+      if (auto *m = site.metric.load(std::memory_order_acquire)) return *m;
+
+      Metric *m = nullptr;
+      for (auto *x : r.list) {
+        if (x->kind == site.kind && std::strcmp(x->name, site.name) == 0) m = x;
+      }
+      if (!m) {
+        m = new Metric(site.name, site.kind);
+        if (site.kind == MetricKind::Histogram) {
+          m->buckets = new std::atomic<uint64_t>[metricShards * histogramSlots]{};
+          m->totalBuckets.assign(histogramSlots, 0);
+        }
+        r.list.push_back(m);
+        r.startLocked();
+      }
+      site.metric.store(m, std::memory_order_release);
+      return *m;
+    }
+  } // namespace impl
+
+  UTILS_LOG_INLINE void reportMetrics() {
+    impl::metricRegistry().report();
+  }
+
+
+  // ============================================================================
+  //                            ScopeLogger (diagnostics.log)
+  // ============================================================================
+  namespace impl {
+
+    struct DiagnosticsFile {
+      std::atomic<int> count{ 0 };
+      std::ofstream fout;
+      RingFile ring;
+      std::mutex mutex;
+      bool initialized = false;
+      bool crashedLastTime = false;
+      bool crashChecked = false;
+      std::string crashSummary;
+      // binary format state
+      bool binary = false;
+      int64_t lastUs = 0;
+      uint32_t lastSiteId = 0;
+      std::string record;
+    };
+
+    UTILS_LOG_INLINE DiagnosticsFile &diagnosticsFile() {
+      static DiagnosticsFile f;
+      return f;
+    }
+
+    inline thread_local ScopeLogger *scopeTop = nullptr;
+
+    // Small per-process thread number (" tN") of diagnostics records.
+    UTILS_LOG_INLINE uint32_t threadIndex() {
+      static std::atomic<uint32_t> next{ 0 };
+      thread_local const uint32_t index = ++next;
+      return index;
+    }
+
+    UTILS_LOG_INLINE bool detectPreviousCrash(DiagnosticsFile &df) {
+      if (df.crashChecked) return df.crashedLastTime;
+      df.crashChecked = true;
+
+      const auto &fname = diagnosticsFilePath;
+      if (!std::filesystem::exists(fname)) return false;
+
+      const auto analysis = analyzeDiagnosticsFile(fname);
+      df.crashedLastTime = analysis.crashed();
+      if (df.crashedLastTime) df.crashSummary = crashSummary(analysis);
+      return df.crashedLastTime;
+    }
+
+    UTILS_LOG_INLINE void putDiagnostics(DiagnosticsFile &df, std::string_view bytes) {
+      if (df.ring.isOpen()) {
+        df.ring.write(bytes.data(), bytes.size());
+      } else if (df.fout.good()) {
+        df.fout.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        df.fout.flush();
+      }
+    }
+
+    // Starts a binary record in df.record: type byte and time delta.
+    UTILS_LOG_INLINE void beginRecord(DiagnosticsFile &df, uint8_t type) {
+      const auto now = nowUs();
+      df.record.clear();
+      df.record.push_back(static_cast<char>(type));
+      diag::putSigned(df.record, now - df.lastUs);
+      df.lastUs = now;
+    }
+
+    // Free-form lines: as they are in text mode, a Text record in binary mode.
+    UTILS_LOG_INLINE void writeDiagnosticsText(DiagnosticsFile &df, std::string_view text) {
+      if (!df.binary) {
+        putDiagnostics(df, std::string(text) + '\n');
+        return;
+      }
+      beginRecord(df, diag::Text);
+      diag::putString(df.record, text);
+      putDiagnostics(df, df.record);
+    }
+
+    // 'R'ing, 'B'inary or 'T'ext, by the first bytes of the file.
+    UTILS_LOG_INLINE char diagnosticsKind(const std::string &fname) {
+      std::ifstream ifs(fname, std::ios::binary);
+      char head[sizeof(diag::RingHeader)] = {};
+      ifs.read(head, sizeof(head));
+      const std::string_view image(head, static_cast<size_t>(ifs.gcount()));
+      return diag::isRing(image) ? 'R' : diag::isBinary(image) ? 'B' : 'T';
+    }
+
+    UTILS_LOG_INLINE void ensureFileOpen(DiagnosticsFile &df) {
+      if (!df.initialized) {
+        const std::string &fname = diagnosticsFilePath;
+        const size_t ringBytes = diagnosticsRingBytes;
+        df.binary = !ringBytes && diagnosticsBinary;
+        detectPreviousCrash(df);
+        // never mix formats in one file
+        const char kind = ringBytes ? 'R' : df.binary ? 'B' : 'T';
+        if (std::filesystem::exists(fname) && std::filesystem::file_size(fname) > 0 && diagnosticsKind(fname) != kind) {
+          std::error_code ec;
+          std::filesystem::remove(fname + ".old", ec);
+          std::filesystem::rename(fname, fname + ".old", ec);
+        }
+        df.initialized = true;
+
+        // a ring has a fixed size and is never rotated
+        if (!ringBytes || !df.ring.open(fname, ringBytes)) {
+          rotateIfTooLarge(fname, 2ull * 1024 * 1024);
+          df.fout.open(fname, df.binary ? std::ios::app | std::ios::binary : std::ios::app);
+        }
+
+        if (df.binary) {
+          df.lastUs = nowUs();
+          df.record.assign(diag::magic, sizeof(diag::magic));
+          df.record.push_back(static_cast<char>(diag::version));
+          diag::putVarint(df.record, static_cast<uint64_t>(df.lastUs));
+          putDiagnostics(df, df.record);
+        }
+        if (df.crashedLastTime) {
+          writeDiagnosticsText(df, "## CRASH POINT ##");
+          writeDiagnosticsText(df, df.crashSummary);
+        }
+      } else if (!df.ring.isOpen() && !df.fout.is_open()) {
+        df.fout.open(diagnosticsFilePath, df.binary ? std::ios::app | std::ios::binary : std::ios::app);
+      }
+    }
+
+    // Per-site aggregates, created on a site's first use and never freed
+    // (sites are static); the registry lists them for reports.
+    struct ScopeStats {
+      ScopeSite *site;
+      std::atomic<uint64_t> calls{ 0 };
+      std::atomic<uint64_t> wallNs{ 0 };
+      std::atomic<uint64_t> counters[counterCount]{};
+      std::atomic<int> source{ 0 };
+      std::atomic<uint64_t> allocs{ 0 };
+      std::atomic<uint64_t> allocBytes{ 0 };
+    };
+
+    struct StatsRegistry {
+      std::mutex mutex;
+      std::vector<ScopeStats *> list;
+    };
+
+    UTILS_LOG_INLINE StatsRegistry &statsRegistry() {
+      static StatsRegistry r;
+      return r;
+    }
+
+    UTILS_LOG_INLINE ScopeStats &scopeStats(ScopeSite &site) {
+      if (auto *st = site.stats.load(std::memory_order_acquire)) return *st;
+      auto &r = statsRegistry();
+      std::scoped_lock lock(r.mutex);
+      if (auto *st = site.stats.load(std::memory_order_acquire)) return *st;
+      auto *st = new ScopeStats{ &site };
+      r.list.push_back(st);
+      site.stats.store(st, std::memory_order_release);
+      return *st;
+    }
+
+    // ------------------------------------------------------------------------
+    // Coverage: a site is pushed on a lock-free list the first time it runs.
+    inline std::atomic<ScopeSite *> coveredHead{ nullptr };
+
+    UTILS_LOG_INLINE void markCovered(ScopeSite &site) {
+      if (site.covered.exchange(true, std::memory_order_relaxed)) return;
+      site.nextCovered = coveredHead.load(std::memory_order_relaxed);
+      while (!coveredHead.compare_exchange_weak(site.nextCovered, &site, std::memory_order_release, std::memory_order_relaxed)) {}
+
+      // at-exit dump, registered with the first covered site
+      struct Dumper {
+        ~Dumper() {
+          if (!coverageFilePath.empty()) writeScopeCoverage(coverageFilePath);
+        }
+      };
+      static Dumper dumper;
+    }
+
+  } // namespace impl
+
+  UTILS_LOG_INLINE ScopeLogger::ScopeLogger(impl::ScopeSite &site)
+    : site_(&site), parent_(impl::scopeTop) {
+    enter();
+  }
+
+  UTILS_LOG_INLINE ScopeLogger::ScopeLogger(impl::ScopeSite &site, std::string_view name)
+    : site_(&site), name_(name), parent_(impl::scopeTop) {
+    enter();
+  }
+
+  UTILS_LOG_INLINE ScopeLogger::ScopeLogger(impl::ScopeSite &site, const impl::ScopeArgs &args)
+    : site_(&site), args_(&args), parent_(impl::scopeTop) {
+    enter();
+  }
+
+  UTILS_LOG_INLINE void ScopeLogger::enter() {
+    impl::scopeTop = this;
+    if (!site_->covered.load(std::memory_order_relaxed)) impl::markCovered(*site_);
+    if (parent_ && parent_->site_ == site_ && parent_->name_ == name_ && impl::collapseRecursion) {
+      root_ = parent_->root_ ? parent_->root_ : parent_;
+      if (root_->entered_ == 0) root_->here("recursing...");
+      root_->entered_++;
+      if (++root_->nested_ > root_->maxNested_) root_->maxNested_ = root_->nested_;
+      return;
+    }
+    log(impl::ScopeEvent::Enter, {});
+    impl::diagnosticsFile().count++;
+    prevAllocTarget_ = impl::allocTarget;
+    impl::allocTarget = &allocs_;
+
+    if (impl::scopeProfiling.load(std::memory_order_relaxed)) {
+      static_assert(sizeof(counters_) / sizeof(counters_[0]) == impl::counterCount);
+      profiled_ = true;
+      impl::ThreadCounters::local().read(counters_);
+      startNs_ = impl::steadyNs();
+    }
+  }
+
+  UTILS_LOG_INLINE void ScopeLogger::profileEnd() {
+    const auto ns = impl::steadyNs();
+    impl::AllocCountPause pause;
+    auto &tc = impl::ThreadCounters::local();
+    uint64_t now[impl::counterCount];
+    tc.read(now);
+    auto &st = impl::scopeStats(*site_);
+    st.calls.fetch_add(1 + entered_, std::memory_order_relaxed); // collapsed entries count as calls
+    st.wallNs.fetch_add(static_cast<uint64_t>(ns - startNs_), std::memory_order_relaxed);
+    for (int i = 0; i < impl::counterCount; ++i) st.counters[i].fetch_add(now[i] - counters_[i], std::memory_order_relaxed);
+    st.source.store(static_cast<int>(tc.source()), std::memory_order_relaxed);
+  }
+
+  UTILS_LOG_INLINE ScopeLogger::~ScopeLogger() {
+    impl::scopeTop = parent_;
+    if (root_) {
+      --root_->nested_;
+      return;
+    }
+    if (entered_) {
+      const auto n = std::to_string(entered_);
+      here("recursion: entered x" + n + ", exited x" + n + ", max depth " + std::to_string(maxNested_ + 1));
+    }
+    if (profiled_) profileEnd();
+    impl::allocTarget = prevAllocTarget_;
+    if (allocs_.count) {
+      impl::AllocCountPause pause;
+      auto &st = impl::scopeStats(*site_);
+      st.allocs.fetch_add(allocs_.count, std::memory_order_relaxed);
+      st.allocBytes.fetch_add(allocs_.bytes, std::memory_order_relaxed);
+    }
+    impl::diagnosticsFile().count--;
+    log(impl::ScopeEvent::Exit, {});
+  }
+
+  namespace impl {
+    UTILS_LOG_INLINE std::vector<ScopeStats *> allScopeStats() {
+      auto &r = statsRegistry();
+      std::scoped_lock lock(r.mutex);
+      return r.list;
+    }
+  }
+
+  UTILS_LOG_INLINE std::string scopeProfileReport() {
+    auto list = impl::allScopeStats();
+    list.erase(std::remove_if(list.begin(), list.end(), [](auto *st) { return st->calls.load() == 0; }), list.end());
+    std::sort(list.begin(), list.end(), [](auto *a, auto *b) { return a->wallNs.load() > b->wallNs.load(); });
+
+    std::ostringstream oss;
+    for (auto *st : list) {
+      const auto calls = st->calls.load();
+      const auto source = static_cast<impl::CounterSource>(st->source.load());
+      oss << st->site->func << ' ' << st->site->file << ':' << st->site->line << " calls=" << calls
+        << " wall-ns=" << st->wallNs.load() << " avg-ns=" << st->wallNs.load() / calls;
+      for (int i = 0; i < impl::counterCount; ++i) {
+        if (*impl::counterName(source, i)) oss << ' ' << impl::counterName(source, i) << '=' << st->counters[i].load();
+      }
+      if (source == impl::CounterSource::Hardware && st->counters[0].load())
+        oss << " ipc=" << std::fixed << std::setprecision(2) << static_cast<double>(st->counters[1].load()) / static_cast<double>(st->counters[0].load()) << std::defaultfloat;
+      oss << '\n';
+    }
+    return oss.str();
+  }
+
+  UTILS_LOG_INLINE std::vector<std::string> coveredScopes() {
+    std::vector<std::string> out;
+    for (auto *s = impl::coveredHead.load(std::memory_order_acquire); s; s = s->nextCovered)
+      out.push_back(std::string(s->file) + ":" + std::to_string(s->line) + " " + s->func);
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+  }
+
+  UTILS_LOG_INLINE bool writeScopeCoverage(const std::string &fname) {
+    auto lines = coveredScopes();
+    {
+      std::ifstream ifs(fname);
+      std::string line;
+      while (std::getline(ifs, line)) {
+        if (!line.empty()) lines.push_back(line);
+      }
+    }
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+    const auto tmp = fname + ".tmp";
+    {
+      std::ofstream ofs(tmp, std::ios::trunc);
+      for (const auto &l : lines) ofs << l << '\n';
+      if (!ofs.good()) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, fname, ec);
+    return !ec;
+  }
+
+  UTILS_LOG_INLINE std::string scopeAllocationReport() {
+    auto list = impl::allScopeStats();
+    list.erase(std::remove_if(list.begin(), list.end(), [](auto *st) { return st->allocs.load() == 0; }), list.end());
+    std::sort(list.begin(), list.end(), [](auto *a, auto *b) { return a->allocBytes.load() > b->allocBytes.load(); });
+
+    std::ostringstream oss;
+    for (auto *st : list) {
+      oss << st->site->func << ' ' << st->site->file << ':' << st->site->line << " allocs=" << st->allocs.load()
+        << " bytes=" << st->allocBytes.load() << '\n';
+    }
+    return oss.str();
+  }
+
+  UTILS_LOG_INLINE const ScopeLogger *ScopeLogger::current() { return impl::scopeTop; }
+
+  namespace impl {
+    // Captured arguments with their strings redacted; other values are kept
+    // as they are (see scope_args.hpp for the layout).
+    UTILS_LOG_INLINE std::string redactScopeArgs(const Redactor &r, std::string_view bytes) {
+      std::string out;
+      size_t pos = 0;
+      while (pos < bytes.size()) {
+        const char tag = bytes[pos];
+        size_t n = 1;
+        if (tag == 'b' || tag == 'c') n += 1;
+        else if (tag == 'i' || tag == 'u' || tag == 'f' || tag == 'p') n += 8;
+        else if ((tag == 's' || tag == 'S') && pos + 1 < bytes.size()) {
+          std::string str(bytes.substr(pos + 2, static_cast<unsigned char>(bytes[pos + 1])));
+          r.apply(str);
+          if (str.size() > 255) str.resize(255);
+          out += tag;
+          out += static_cast<char>(str.size());
+          out += str;
+          pos += 2 + static_cast<unsigned char>(bytes[pos + 1]);
+          continue;
+        }
+        else if (tag == 'x' && pos + 1 < bytes.size()) n += 1 + static_cast<unsigned char>(bytes[pos + 1]);
+        out.append(bytes.substr(pos, n));
+        pos += n;
+      }
+      return out;
+    }
+  }
+
+  UTILS_LOG_INLINE void ScopeLogger::log(impl::ScopeEvent ev, std::string_view msg) const {
+    if (!impl::diagnosticsEnabled.load(std::memory_order_relaxed)) return;
+    impl::AllocCountPause pause;
+    auto &df = impl::diagnosticsFile();
+    std::scoped_lock lock(df.mutex);
+    impl::ensureFileOpen(df);
+    const auto count = df.count.load();
+    // the strings a scope record carries are redacted like log records
+    const auto *redactor = impl::redactor.load(std::memory_order_acquire);
+
+    if (!df.binary) {
+      const std::string_view phase = ev == impl::ScopeEvent::Enter ? "start..." : ev == impl::ScopeEvent::Exit ? "end!" : msg;
+      //const auto msg = std::format("[{}] t{} {}:{} {} |{}\n", dateTime(), threadIndex(), func(), phase, file(), count);
+      auto event = func() + ":" + std::string(phase) + (ev == impl::ScopeEvent::Enter && args_ ? " (" + args() + ")" : std::string());
+      if (redactor) redactor->apply(event);
+      const auto line = ("[" + impl::dateTime() + "] t" + std::to_string(impl::threadIndex()) + " " + event + " " + site_->file + " |" + std::to_string(count) + "\n");
+      impl::putDiagnostics(df, line);
+      return;
+    }
+
+    if (!site_->id) {
+      site_->id = ++df.lastSiteId;
+      df.record.clear();
+      df.record.push_back(static_cast<char>(diag::SiteDef));
+      diag::putVarint(df.record, site_->id);
+      diag::putVarint(df.record, static_cast<uint64_t>(site_->line));
+      diag::putString(df.record, site_->func);
+      diag::putString(df.record, site_->file);
+      diag::putString(df.record, site_->args ? site_->args : "");
+      impl::putDiagnostics(df, df.record);
+    }
+    const uint8_t type = ev == impl::ScopeEvent::Enter ? diag::Enter : ev == impl::ScopeEvent::Exit ? diag::Exit : diag::Here;
+    const bool withArgs = ev == impl::ScopeEvent::Enter && args_;
+    impl::beginRecord(df, static_cast<uint8_t>(type | (name_.empty() ? 0 : diag::typeNamed) | (withArgs ? diag::typeArgs : 0)));
+    diag::putVarint(df.record, site_->id);
+    diag::putVarint(df.record, impl::threadIndex());
+    diag::putVarint(df.record, static_cast<uint64_t>(count < 0 ? 0 : count));
+    auto putRedacted = [&](std::string_view text) {
+      if (!redactor) return diag::putString(df.record, text);
+      std::string copy(text);
+      redactor->apply(copy);
+      diag::putString(df.record, copy);
+    };
+    if (!name_.empty()) putRedacted(name_);
+    if (withArgs) diag::putString(df.record, redactor ? impl::redactScopeArgs(*redactor, args_->bytes()) : std::string(args_->bytes()));
+    if (ev == impl::ScopeEvent::Here) putRedacted(msg);
+    impl::putDiagnostics(df, df.record);
+  }
+
+
+  // ============================================================================
+  //                            LOG_CHECK / LOG_FATAL
+  // ============================================================================
+  UTILS_LOG_INLINE UTILS_LOG_COLD impl::FatalLog::FatalLog(const char *cond, const char *file, int line)
+    : Log(Level::Fatal, true) {
+    RecordBuffer where;
+    where.append(cond ? "Check failed: " : "Fatal at ");
+    if (cond) {
+      where.append(cond);
+      where.append(" at ");
+    }
+    where.append(file);
+    where.append(':');
+    where.appendInt(line);
+    *this << where.view();
+  }
+
+  UTILS_LOG_INLINE UTILS_LOG_COLD impl::FatalLog::~FatalLog() {
+    std::string out = "[" + impl::dateTime() + "] ## FATAL ## " + std::string(text()) + "\n";
+    for (auto s = ScopeLogger::current(); s; s = s->parent()) {
+      int depth = 1;
+      for (; s->recursionRoot(); s = s->parent()) ++depth;
+      out += "  in " + s->func() + (s->args().empty() ? "" : " (" + s->args() + ")") + " " + s->file() + ":" + std::to_string(s->line())
+        + (depth > 1 ? " x" + std::to_string(depth) : std::string()) + "\n";
+    }
+    impl::StackTrace st;
+    st.capture(1);
+    for (int i = 0; i < st.size; ++i)
+      out += "  #" + std::to_string(i) + " " + impl::symbolize(st.frames[i]) + "\n";
+    if (const auto *r = impl::redactor.load(std::memory_order_acquire)) r->apply(out);
+
+    commit();
+    std::cout.flush();
+    std::cerr.flush();
+    {
+      auto &df = impl::diagnosticsFile();
+      std::scoped_lock lock(df.mutex);
+      impl::ensureFileOpen(df);
+      out.pop_back();
+      impl::writeDiagnosticsText(df, out);
+    }
+    if (!impl::coverageFilePath.empty()) writeScopeCoverage(impl::coverageFilePath);
+    Log::terminate();
+    std::abort();
+  }
+
+} // namespace utils_log
@@ -0,0 +1,112 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__has_include)
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UTILS_LOG_MMAP 1
+#endif
+#endif
+
+
+namespace utils_log::impl {
+
+  // ============================================================================
+  //                          MappedFile (read-only)
+  // ============================================================================
+  // Whole-file read-only view for the analysis and search tools; falls back to
+  // reading the file into memory where mapping is not available.
+  class MappedFile {
+  public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &fname) { open(fname); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &fname) {
+      close();
+#if defined(_WIN32)
+      file_ = ::CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file_ == INVALID_HANDLE_VALUE) return false;
+      LARGE_INTEGER size{};
+      ::GetFileSizeEx(file_, &size);
+      size_ = static_cast<size_t>(size.QuadPart);
+      if (size_ == 0) return true;
+      map_ = ::CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (map_) data_ = static_cast<const char *>(::MapViewOfFile(map_, FILE_MAP_READ, 0, 0, 0));
+      if (data_) return true;
+      close();
+#elif defined(UTILS_LOG_MMAP)
+      const int fd = ::open(fname.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+      struct stat st {};
+      if (::fstat(fd, &st) == 0) {
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+          ::close(fd);
+          return true;
+        }
+        void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          data_ = static_cast<const char *>(p);
+          mapped_ = true;
+          ::madvise(p, size_, MADV_SEQUENTIAL);
+        }
+      }
+      ::close(fd);
+      if (data_) return true;
+      size_ = 0;
+#endif
+      std::ifstream ifs(fname, std::ios::binary);
+      if (!ifs.is_open()) return false;
+      copy_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      data_ = copy_.data();
+      size_ = copy_.size();
+      return true;
+    }
+
+    std::string_view view() const { return data_ ? std::string_view(data_, size_) : std::string_view(); }
+
+    void close() {
+#if defined(_WIN32)
+      if (data_ && copy_.empty()) ::UnmapViewOfFile(data_);
+      if (map_) ::CloseHandle(map_);
+      if (file_ != INVALID_HANDLE_VALUE) ::CloseHandle(file_);
+      map_ = nullptr;
+      file_ = INVALID_HANDLE_VALUE;
+#elif defined(UTILS_LOG_MMAP)
+      if (mapped_) ::munmap(const_cast<char *>(data_), size_);
+      mapped_ = false;
+#endif
+      data_ = nullptr;
+      size_ = 0;
+      copy_.clear();
+    }
+
+  private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    std::string copy_;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE map_ = nullptr;
+#elif defined(UTILS_LOG_MMAP)
+    bool mapped_ = false;
+#endif
+  };
+
+} // namespace utils_log::impl
@@ -0,0 +1,180 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#define UTILS_LOG_PERF_EVENTS 1
+#endif
+#endif
+
+
+namespace utils_log::impl {
+
+  // ============================================================================
+  //                      Per-thread counters (scope profiling)
+  // ============================================================================
+  // Each thread opens, on first use, the best source the environment allows:
+  //   Hardware  perf_event_open group: cycles, instructions, cache misses, branch misses
+  //   Software  perf_event_open group: task-clock, page faults, context switches, migrations
+  //   Rusage    CLOCK_THREAD_CPUTIME_ID and getrusage(RUSAGE_THREAD), for VMs and
+  //             containers without perf events
+  // Hardware counters are read with rdpmc where the kernel enables it for user
+  // space (x86), otherwise with one read() of the group.
+  enum class CounterSource { None, Hardware, Software, Rusage };
+
+  inline constexpr int counterCount = 4;
+
+  inline const char *counterName(CounterSource s, int i) {
+    static const char *const names[][counterCount] = {
+      { "", "", "", "" },
+      { "cycles", "instructions", "cache-misses", "branch-misses" },
+      { "task-clock-ns", "page-faults", "context-switches", "cpu-migrations" },
+      { "cpu-ns", "minor-faults", "major-faults", "context-switches" },
+    };
+    return names[static_cast<int>(s)][i];
+  }
+
+  class ThreadCounters {
+  public:
+    ThreadCounters() {
+#if defined(UTILS_LOG_PERF_EVENTS)
+      if (openGroup(PERF_TYPE_HARDWARE, { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES })) {
+        source_ = CounterSource::Hardware;
+        mapPages();
+      } else if (openGroup(PERF_TYPE_SOFTWARE, { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS,
+        PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS })) {
+        source_ = CounterSource::Software;
+      } else {
+        source_ = CounterSource::Rusage;
+      }
+#endif
+    }
+
+    ThreadCounters(const ThreadCounters &) = delete;
+    ThreadCounters &operator=(const ThreadCounters &) = delete;
+
+    ~ThreadCounters() {
+#if defined(UTILS_LOG_PERF_EVENTS)
+      for (int i = 0; i < counterCount; ++i) {
+        if (pages_[i]) ::munmap(pages_[i], static_cast<size_t>(::sysconf(_SC_PAGESIZE)));
+        if (fds_[i] >= 0) ::close(fds_[i]);
+      }
+#endif
+    }
+
+    static ThreadCounters &local() {
+      thread_local ThreadCounters c;
+      return c;
+    }
+
+    CounterSource source() const { return source_; }
+
+    void read(uint64_t (&out)[counterCount]) {
+      std::memset(out, 0, sizeof(out));
+#if defined(UTILS_LOG_PERF_EVENTS)
+      if (source_ == CounterSource::Hardware || source_ == CounterSource::Software) {
+        if (rdpmc(out)) return;
+        // PERF_FORMAT_GROUP: nr, then one value per event
+        uint64_t buf[1 + counterCount] = {};
+        if (::read(fds_[0], buf, sizeof(buf)) > 0) {
+          for (int i = 0; i < counterCount && i < static_cast<int>(buf[0]); ++i) out[i] = buf[1 + i];
+        }
+      } else if (source_ == CounterSource::Rusage) {
+        timespec ts{};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        out[0] = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+#if defined(RUSAGE_THREAD)
+        rusage ru{};
+        if (::getrusage(RUSAGE_THREAD, &ru) == 0) {
+          out[1] = static_cast<uint64_t>(ru.ru_minflt);
+          out[2] = static_cast<uint64_t>(ru.ru_majflt);
+          out[3] = static_cast<uint64_t>(ru.ru_nvcsw + ru.ru_nivcsw);
+        }
+#endif
+      }
+#else
+      (void)out;
+#endif
+    }
+
+  private:
+    CounterSource source_ = CounterSource::None;
+#if defined(UTILS_LOG_PERF_EVENTS)
+    int fds_[counterCount] = { -1, -1, -1, -1 };
+    perf_event_mmap_page *pages_[counterCount] = {};
+
+    bool openGroup(uint32_t type, const uint64_t (&configs)[counterCount]) {
+      for (int i = 0; i < counterCount; ++i) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = configs[i];
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        const long fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0);
+        if (fd < 0) {
+          for (int j = 0; j < i; ++j) ::close(fds_[j]);
+          for (auto &f : fds_) f = -1;
+          return false;
+        }
+        fds_[i] = static_cast<int>(fd);
+      }
+      ::ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      return true;
+    }
+
+    void mapPages() {
+#if defined(__x86_64__) || defined(__i386__)
+      const auto size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+      for (int i = 0; i < counterCount; ++i) {
+        void *p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fds_[i], 0);
+        pages_[i] = p == MAP_FAILED ? nullptr : static_cast<perf_event_mmap_page *>(p);
+      }
+#endif
+    }
+
+    // User-space read of the whole group; false if any event is not
+    // currently readable this way.
+    bool rdpmc(uint64_t (&out)[counterCount]) {
+#if defined(__x86_64__) || defined(__i386__)
+      for (int i = 0; i < counterCount; ++i) {
+        auto *pc = pages_[i];
+        if (!pc) return false;
+        uint32_t seq;
+        do {
+          seq = pc->lock;
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+          const uint32_t idx = pc->index;
+          if (!pc->cap_user_rdpmc || !idx) return false;
+          uint32_t lo, hi;
+          __asm__ volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(idx - 1));
+          const auto width = pc->pmc_width;
+          int64_t pmc = static_cast<int64_t>((static_cast<uint64_t>(hi) << 32) | lo);
+          pmc = static_cast<int64_t>(static_cast<uint64_t>(pmc) << (64 - width)) >> (64 - width);
+          out[i] = static_cast<uint64_t>(pc->offset + pmc);
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (pc->lock != seq);
+      }
+      return true;
+#else
+      (void)out;
+      return false;
+#endif
+    }
+#endif
+  };
+
+} // namespace utils_log::impl
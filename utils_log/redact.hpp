@@ -0,0 +1,305 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTILS_LOG_SSE2 1
+#endif
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                      Redaction (SET_LOG_REDACTION)
+  // ============================================================================
+  // Literals are matched case-insensitively, all at once, by an Aho-Corasick
+  // automaton compiled to a DFA over byte classes. A vectorized pass over the
+  // message first looks for the literals' first bytes, '@' and digits; most
+  // messages stop there.
+  struct RedactionRules {
+    std::vector<std::string> secrets; // masked wherever they occur: "***"
+    std::vector<std::string> keys;    // the value after them is masked: "password=***"
+    bool emails = false;              // "***@example.com"
+    bool cards = false;               // 13-19 digits, spaces or dashes between, passing the Luhn check: "************1234"
+  };
+
+  class Redactor {
+  public:
+    explicit Redactor(const RedactionRules &rules) : emails_(rules.emails), cards_(rules.cards) {
+      for (const auto &s : rules.secrets) addPattern(s, false);
+      for (const auto &k : rules.keys) addPattern(k, true);
+      build();
+    }
+
+    // True if anything was masked.
+    bool apply(std::string &msg) const {
+      const auto hits = prefilter(msg);
+      if (!hits.literal && !hits.at && hits.digits < minCardDigits) return false;
+
+      std::vector<Span> spans;
+      if (hits.literal && states_ > 1) findLiterals(msg, spans);
+      if (hits.at && emails_) findEmails(msg, spans);
+      if (hits.digits >= minCardDigits && cards_) findCards(msg, spans);
+      if (spans.empty()) return false;
+
+      // overlapping or touching spans are masked as their union
+      std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) { return a.begin < b.begin; });
+      size_t merged = 0;
+      for (size_t i = 1; i < spans.size(); ++i) {
+        auto &cur = spans[merged];
+        if (spans[i].begin <= cur.end) {
+          if (spans[i].end > cur.end) cur.end = spans[i].end;
+          if (cur.keepDigits != spans[i].keepDigits) cur.keepDigits = 0; // a card within a secret: mask all
+        } else {
+          spans[++merged] = spans[i];
+        }
+      }
+      spans.resize(merged + 1);
+
+      std::string out;
+      out.reserve(msg.size());
+      size_t pos = 0;
+      for (const auto &sp : spans) {
+        out.append(msg, pos, sp.begin - pos);
+        if (sp.keepDigits) {
+          // all digits but the last keepDigits
+          int digits = 0;
+          for (size_t i = sp.begin; i < sp.end; ++i) digits += isDigit(msg[i]);
+          for (size_t i = sp.begin; i < sp.end; ++i) {
+            if (isDigit(msg[i])) out += --digits < sp.keepDigits ? msg[i] : '*';
+          }
+        } else {
+          out += "***";
+        }
+        pos = sp.end;
+      }
+      out.append(msg, pos, std::string::npos);
+      msg.swap(out);
+      return true;
+    }
+
+  private:
+    static constexpr size_t minCardDigits = 13;
+    static constexpr size_t maxCardDigits = 19;
+
+    struct Span {
+      size_t begin;
+      size_t end;
+      int keepDigits; // 0: replaced by "***"
+    };
+
+    struct Hits {
+      bool literal = false;
+      bool at = false;
+      size_t digits = 0;
+    };
+
+    // Patterns
+    std::vector<size_t> length_;
+    std::vector<bool> isKey_;
+    std::vector<std::string> patterns_;
+
+    // DFA: next_[state * classes_ + classOf_[byte]]; match_[state] is the
+    // longest pattern ending there, -1 for none.
+    uint8_t classOf_[256] = {};
+    int classes_ = 1;
+    int states_ = 1;
+    std::vector<int32_t> next_;
+    std::vector<int32_t> match_;
+
+    // First bytes of the patterns, both cases; empty with more than fit the
+    // vector prefilter (then every message runs the DFA).
+    std::vector<unsigned char> first_;
+    bool anyFirst_ = false;
+
+    bool emails_;
+    bool cards_;
+
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    static char lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+    static char upper(char c) { return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c; }
+
+    void addPattern(const std::string &p, bool key) {
+      if (p.empty()) return;
+      patterns_.push_back(p);
+      length_.push_back(p.size());
+      isKey_.push_back(key);
+    }
+
+    void build() {
+      for (const auto &p : patterns_) {
+        for (char c : p) {
+          const auto l = static_cast<unsigned char>(lower(c));
+          if (!classOf_[l]) {
+            classOf_[l] = static_cast<uint8_t>(classes_);
+            classOf_[static_cast<unsigned char>(upper(c))] = static_cast<uint8_t>(classes_);
+            ++classes_;
+          }
+        }
+      }
+
+      // trie
+      next_.assign(static_cast<size_t>(classes_), -1);
+      match_.assign(1, -1);
+      for (size_t id = 0; id < patterns_.size(); ++id) {
+        int s = 0;
+        for (char c : patterns_[id]) {
+          auto &t = next_[static_cast<size_t>(s) * classes_ + classOf_[static_cast<unsigned char>(c)]];
+          if (t < 0) {
+            t = states_++;
+            next_.resize(static_cast<size_t>(states_) * classes_, -1);
+            match_.push_back(-1);
+          }
+          s = next_[static_cast<size_t>(s) * classes_ + classOf_[static_cast<unsigned char>(c)]];
+        }
+        if (match_[s] < 0) match_[s] = static_cast<int32_t>(id);
+      }
+
+      // failure links, breadth first, folded into the transitions
+      std::vector<int32_t> fail(static_cast<size_t>(states_), 0);
+      std::vector<int32_t> queue;
+      for (int c = 0; c < classes_; ++c) {
+        auto &t = next_[c];
+        if (t < 0) t = 0;
+        else queue.push_back(t);
+      }
+      for (size_t qi = 0; qi < queue.size(); ++qi) {
+        const int r = queue[qi];
+        if (match_[r] < 0) match_[r] = match_[fail[r]]; // a suffix is shorter than the state's own pattern
+        for (int c = 0; c < classes_; ++c) {
+          auto &t = next_[static_cast<size_t>(r) * classes_ + c];
+          const int viaFail = next_[static_cast<size_t>(fail[r]) * classes_ + c];
+          if (t < 0) {
+            t = viaFail;
+          } else {
+            fail[t] = viaFail;
+            queue.push_back(t);
+          }
+        }
+      }
+
+      for (const auto &p : patterns_) {
+        for (char c : { lower(p[0]), upper(p[0]) }) {
+          if (std::find(first_.begin(), first_.end(), static_cast<unsigned char>(c)) == first_.end())
+            first_.push_back(static_cast<unsigned char>(c));
+        }
+      }
+      anyFirst_ = !first_.empty();
+      if (first_.size() > 8) first_.clear();
+    }
+
+    Hits prefilter(std::string_view s) const {
+      Hits h;
+      const bool everyMessage = anyFirst_ && first_.empty();
+      h.literal = everyMessage;
+      size_t i = 0;
+#if defined(UTILS_LOG_SSE2)
+      const auto at = _mm_set1_epi8('@');
+      const auto zero = _mm_set1_epi8('0');
+      const auto nine = _mm_set1_epi8(9);
+      __m128i firsts[8];
+      const size_t nfirst = first_.size();
+      for (size_t k = 0; k < nfirst; ++k) firsts[k] = _mm_set1_epi8(static_cast<char>(first_[k]));
+      for (; i + 16 <= s.size(); i += 16) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+        __m128i lit = _mm_setzero_si128();
+        for (size_t k = 0; k < nfirst; ++k) lit = _mm_or_si128(lit, _mm_cmpeq_epi8(v, firsts[k]));
+        const auto d = _mm_sub_epi8(v, zero);
+        const auto digit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d); // v - '0' <= 9, unsigned
+        h.literal |= _mm_movemask_epi8(lit) != 0;
+        h.at |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, at)) != 0;
+        auto bits = static_cast<unsigned>(_mm_movemask_epi8(digit));
+        for (; bits; bits &= bits - 1) ++h.digits;
+      }
+#endif
+      for (; i < s.size(); ++i) {
+        const auto c = static_cast<unsigned char>(s[i]);
+        h.literal |= std::find(first_.begin(), first_.end(), c) != first_.end();
+        h.at |= c == '@';
+        h.digits += isDigit(static_cast<char>(c));
+      }
+      return h;
+    }
+
+    void findLiterals(const std::string &s, std::vector<Span> &spans) const {
+      int state = 0;
+      for (size_t i = 0; i < s.size(); ++i) {
+        state = next_[static_cast<size_t>(state) * classes_ + classOf_[static_cast<unsigned char>(s[i])]];
+        const int id = match_[state];
+        if (id < 0) continue;
+        if (!isKey_[id]) {
+          spans.push_back(Span{ i + 1 - length_[id], i + 1, 0 });
+          continue;
+        }
+        // the value: up to whitespace, a quote or a separator
+        size_t b = i + 1;
+        while (b < s.size() && s[b] == ' ') ++b;
+        size_t e = b;
+        while (e < s.size() && !std::strchr(" \t\r\n\"',;&)]}", s[e])) ++e;
+        if (e > b) spans.push_back(Span{ b, e, 0 });
+      }
+    }
+
+    static bool isEmailChar(char c, bool local) {
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || isDigit(c) || c == '.' || c == '-'
+        || (local && (c == '_' || c == '+' || c == '%'));
+    }
+
+    void findEmails(const std::string &s, std::vector<Span> &spans) const {
+      for (auto at = s.find('@'); at != std::string::npos; at = s.find('@', at + 1)) {
+        size_t b = at;
+        while (b > 0 && isEmailChar(s[b - 1], true)) --b;
+        size_t e = at + 1;
+        while (e < s.size() && isEmailChar(s[e], false)) ++e;
+        const auto domain = std::string_view(s).substr(at + 1, e - at - 1);
+        const auto dot = domain.rfind('.');
+        if (b == at || dot == std::string_view::npos || dot == 0 || dot + 1 == domain.size()) continue;
+        spans.push_back(Span{ b, at, 0 });
+      }
+    }
+
+    static bool luhn(const char *digits, size_t n) {
+      int sum = 0;
+      for (size_t i = 0; i < n; ++i) {
+        int d = digits[n - 1 - i] - '0';
+        if (i & 1) d = d * 2 > 9 ? d * 2 - 9 : d * 2;
+        sum += d;
+      }
+      return sum % 10 == 0;
+    }
+
+    // Runs of digits with single spaces or dashes between them.
+    void findCards(const std::string &s, std::vector<Span> &spans) const {
+      size_t i = 0;
+      while (i < s.size()) {
+        if (!isDigit(s[i]) || (i > 0 && (isDigit(s[i - 1]) || s[i - 1] == '.'))) {
+          ++i;
+          continue;
+        }
+        char digits[maxCardDigits + 1];
+        size_t n = 0, e = i;
+        bool tooLong = false;
+        while (e < s.size()) {
+          if (isDigit(s[e])) {
+            if (n == maxCardDigits) tooLong = true;
+            else digits[n++] = s[e];
+            ++e;
+          } else if ((s[e] == ' ' || s[e] == '-') && e + 1 < s.size() && isDigit(s[e + 1])) {
+            ++e;
+          } else {
+            break;
+          }
+        }
+        if (!tooLong && n >= minCardDigits && luhn(digits, n)) spans.push_back(Span{ i, e, 4 });
+        i = e;
+      }
+    }
+  };
+
+} // namespace utils_log
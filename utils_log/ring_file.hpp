@@ -0,0 +1,154 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "diag_format.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define UTILS_LOG_MMAP 1
+#elif defined(__has_include)
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UTILS_LOG_MMAP 1
+#endif
+#endif
+
+
+namespace utils_log::impl {
+
+  // ============================================================================
+  //                      RingFile (circular diagnostics.log)
+  // ============================================================================
+  // Preallocated, memory-mapped file in the layout of diag::RingHeader. A write
+  // is a memcpy into the mapping plus a header update; the kernel writes the
+  // pages back, so records survive a crash of the process (not of the machine).
+  // An existing ring of the same capacity is continued.
+  class RingFile {
+  public:
+    RingFile() = default;
+    RingFile(const RingFile &) = delete;
+    RingFile &operator=(const RingFile &) = delete;
+    ~RingFile() { close(); }
+
+    bool open(const std::string &fname, uint64_t capacity) {
+      close();
+      if (!capacity) return false;
+      const uint64_t total = diag::ringHeaderSize + capacity;
+#if defined(_WIN32)
+      file_ = ::CreateFileA(fname.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file_ == INVALID_HANDLE_VALUE) return false;
+      LARGE_INTEGER size{};
+      ::GetFileSizeEx(file_, &size);
+      if (static_cast<uint64_t>(size.QuadPart) != total) {
+        LARGE_INTEGER zero{}, end{};
+        end.QuadPart = static_cast<LONGLONG>(total);
+        ::SetFilePointerEx(file_, zero, nullptr, FILE_BEGIN);
+        ::SetEndOfFile(file_);
+        if (!::SetFilePointerEx(file_, end, nullptr, FILE_BEGIN) || !::SetEndOfFile(file_)) return fail();
+      }
+      map_ = ::CreateFileMappingA(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(total >> 32), static_cast<DWORD>(total), nullptr);
+      if (!map_) return fail();
+      base_ = static_cast<char *>(::MapViewOfFile(map_, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(total)));
+      if (!base_) return fail();
+#elif defined(UTILS_LOG_MMAP)
+      fd_ = ::open(fname.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd_ < 0) return false;
+      struct stat st {};
+      if (::fstat(fd_, &st) != 0) return fail();
+      if (static_cast<uint64_t>(st.st_size) != total) {
+        if (::ftruncate(fd_, 0) != 0) return fail();
+#if defined(__linux__)
+        // reserve the blocks now: a full disk must not SIGBUS a later memcpy
+        if (::posix_fallocate(fd_, 0, static_cast<off_t>(total)) != 0) return fail();
+#else
+        if (::ftruncate(fd_, static_cast<off_t>(total)) != 0) return fail();
+#endif
+      }
+      void *p = ::mmap(nullptr, static_cast<size_t>(total), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      if (p == MAP_FAILED) return fail();
+      base_ = static_cast<char *>(p);
+#else
+      (void)fname;
+      return false;
+#endif
+      size_ = static_cast<size_t>(total);
+
+      auto *h = header();
+      if (std::memcmp(h->magic, diag::ringMagic, sizeof(diag::ringMagic)) != 0 || h->version != 1
+        || h->capacity != capacity || h->head >= capacity) {
+        std::memset(h, 0, sizeof(*h));
+        std::memcpy(h->magic, diag::ringMagic, sizeof(diag::ringMagic));
+        h->version = 1;
+        h->capacity = capacity;
+      }
+      return true;
+    }
+
+    bool isOpen() const { return base_ != nullptr; }
+
+    // Longer writes than the capacity keep their last `capacity` bytes.
+    void write(const char *data, size_t n) {
+      auto *h = header();
+      const auto cap = static_cast<size_t>(h->capacity);
+      if (n > cap) {
+        data += n - cap;
+        n = cap;
+      }
+      char *ring = base_ + diag::ringHeaderSize;
+      auto head = static_cast<size_t>(h->head);
+      const size_t first = n < cap - head ? n : cap - head;
+      std::memcpy(ring + head, data, first);
+      std::memcpy(ring, data + first, n - first);
+      head += n;
+      if (head >= cap) {
+        head -= cap;
+        h->wraps++;
+      }
+      h->head = head;
+    }
+
+    void close() {
+#if defined(_WIN32)
+      if (base_) ::UnmapViewOfFile(base_);
+      if (map_) ::CloseHandle(map_);
+      if (file_ != INVALID_HANDLE_VALUE) ::CloseHandle(file_);
+      map_ = nullptr;
+      file_ = INVALID_HANDLE_VALUE;
+#elif defined(UTILS_LOG_MMAP)
+      if (base_) ::munmap(base_, size_);
+      if (fd_ >= 0) ::close(fd_);
+      fd_ = -1;
+#endif
+      base_ = nullptr;
+      size_ = 0;
+    }
+
+  private:
+    char *base_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE map_ = nullptr;
+#elif defined(UTILS_LOG_MMAP)
+    int fd_ = -1;
+#endif
+
+    diag::RingHeader *header() { return reinterpret_cast<diag::RingHeader *>(base_); }
+
+    bool fail() {
+      close();
+      return false;
+    }
+  };
+
+} // namespace utils_log::impl
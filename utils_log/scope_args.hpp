@@ -0,0 +1,218 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                      Scope arguments (LOG_START_ARGS)
+  // ============================================================================
+  // Arguments are captured as tagged raw bytes, native byte order:
+  //   'b' bool(1)  'c' char(1)  'i' int64(8)  'u' uint64(8)  'f' double(8)
+  //   'p' pointer(8)  's' / 'S' len(1) bytes (string; 'S': cut at maxString)
+  //   'x' len(1) bytes (other trivially copyable types up to maxRaw bytes)
+  //   '?' (not capturable)  '.' (out of room; nothing follows)
+  // and only formatted by formatScopeArgs() when written as text or dumped.
+  namespace impl {
+
+    class ScopeArgs {
+    public:
+      static constexpr size_t capacity = 128;
+      static constexpr size_t maxString = 32;
+      static constexpr size_t maxRaw = 16;
+
+      template <typename... Ts>
+      explicit ScopeArgs(const Ts &...args) { (add(args), ...); }
+
+      ScopeArgs(const ScopeArgs &) = delete;
+      ScopeArgs &operator=(const ScopeArgs &) = delete;
+
+      std::string_view bytes() const { return std::string_view(buf_, size_); }
+
+    private:
+      char buf_[capacity];
+      size_t size_ = 0;
+      bool full_ = false;
+
+      void put(char tag, const void *data, size_t n, bool withLength = false) {
+        if (full_) return;
+        const size_t need = 1 + (withLength ? 1 : 0) + n;
+        if (size_ + need > capacity - 1) {
+          buf_[size_++] = '.';
+          full_ = true;
+          return;
+        }
+        buf_[size_++] = tag;
+        if (withLength) buf_[size_++] = static_cast<char>(n);
+        std::memcpy(buf_ + size_, data, n);
+        size_ += n;
+      }
+
+      void putString(const char *s, size_t n) {
+        const bool cut = n > maxString;
+        put(cut ? 'S' : 's', s, cut ? maxString : n, true);
+      }
+
+      template <typename T>
+      void add(const T &v) {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+          put('b', &v, 1);
+        } else if constexpr (std::is_same_v<U, char>) {
+          put('c', &v, 1);
+        } else if constexpr (std::is_enum_v<U>) {
+          add(static_cast<std::underlying_type_t<U>>(v));
+        } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+          const auto x = static_cast<int64_t>(v);
+          put('i', &x, sizeof(x));
+        } else if constexpr (std::is_integral_v<U>) {
+          const auto x = static_cast<uint64_t>(v);
+          put('u', &x, sizeof(x));
+        } else if constexpr (std::is_floating_point_v<U>) {
+          const auto x = static_cast<double>(v);
+          put('f', &x, sizeof(x));
+        } else if constexpr (std::is_array_v<T> && std::is_same_v<std::remove_cv_t<std::remove_extent_t<T>>, char>) {
+          // before the pointer case: U is the decayed array
+          putString(v, strnlen(v, std::extent_v<T>));
+        } else if constexpr (std::is_same_v<U, const char *> || std::is_same_v<U, char *>) {
+          if (v) {
+            putString(v, strnlen(v, maxString + 1));
+          } else {
+            const uint64_t null = 0;
+            put('p', &null, sizeof(null));
+          }
+        } else if constexpr (std::is_convertible_v<const U &, std::string_view>) {
+          const std::string_view s(v);
+          putString(s.data(), s.size());
+        } else if constexpr (std::is_pointer_v<U>) {
+          const auto x = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v));
+          put('p', &x, sizeof(x));
+        } else if constexpr (std::is_trivially_copyable_v<U> && sizeof(U) <= maxRaw) {
+          put('x', &v, sizeof(U), true);
+        } else {
+          put('?', nullptr, 0);
+        }
+      }
+
+      static size_t strnlen(const char *s, size_t n) {
+        const void *z = std::memchr(s, 0, n);
+        return z ? static_cast<size_t>(static_cast<const char *>(z) - s) : n;
+      }
+    };
+
+    // Next argument name of a "#__VA_ARGS__" list; top-level commas only.
+    inline std::string_view nextArgName(std::string_view &names) {
+      int nest = 0;
+      char quote = 0;
+      size_t i = 0;
+      for (; i < names.size(); ++i) {
+        const char c = names[i];
+        if (quote) {
+          if (c == '\\') ++i;
+          else if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') quote = c;
+        else if (c == '(' || c == '[' || c == '{') ++nest;
+        else if (c == ')' || c == ']' || c == '}') --nest;
+        else if (c == ',' && nest <= 0) break;
+      }
+      auto name = names.substr(0, i);
+      names.remove_prefix(i < names.size() ? i + 1 : i);
+      while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+      while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+      return name;
+    }
+
+    // Quotes, backslashes and line breaks escaped so that a value stays on
+    // its record's line.
+    inline void appendEscaped(std::string &out, std::string_view s) {
+      for (const char c : s) {
+        switch (c) {
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        default: out += c; break;
+        }
+      }
+    }
+
+  } // namespace impl
+
+  // "a=1, s=\"abc\"" from the names of LOG_START_ARGS and the captured bytes.
+  inline std::string formatScopeArgs(std::string_view names, std::string_view bytes) {
+    std::string out;
+    char buf[64];
+    size_t pos = 0;
+    int index = 0;
+    auto take = [&](void *dst, size_t n) {
+      if (n > bytes.size() - pos) return false;
+      std::memcpy(dst, bytes.data() + pos, n);
+      pos += n;
+      return true;
+    };
+
+    while (pos < bytes.size()) {
+      const char tag = bytes[pos++];
+      if (tag == '.') {
+        out += out.empty() ? "..." : ", ...";
+        break;
+      }
+      if (!out.empty()) out += ", ";
+      auto name = impl::nextArgName(names);
+      if (name.empty()) {
+        std::snprintf(buf, sizeof(buf), "arg%d", index);
+        out += buf;
+      } else {
+        out.append(name.data(), name.size());
+      }
+      out += '=';
+      ++index;
+
+      bool ok = true;
+      switch (tag) {
+      case 'b': { char v = 0; ok = take(&v, 1); out += v ? "true" : "false"; break; }
+      case 'c': { char v = 0; ok = take(&v, 1); out += '\''; impl::appendEscaped(out, std::string_view(&v, 1)); out += '\''; break; }
+      case 'i': { int64_t v = 0; ok = take(&v, 8); out += std::to_string(v); break; }
+      case 'u': { uint64_t v = 0; ok = take(&v, 8); out += std::to_string(v); break; }
+      case 'f': { double v = 0; ok = take(&v, 8); std::snprintf(buf, sizeof(buf), "%g", v); out += buf; break; }
+      case 'p': {
+        uint64_t v = 0;
+        ok = take(&v, 8);
+        if (v) std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(v));
+        out += v ? buf : "(null)";
+        break;
+      }
+      case 's': case 'S': case 'x': {
+        unsigned char n = 0;
+        ok = take(&n, 1) && n <= bytes.size() - pos;
+        if (!ok) break;
+        const auto data = bytes.substr(pos, n);
+        pos += n;
+        if (tag == 'x') {
+          out += '{';
+          for (size_t i = 0; i < data.size(); ++i) {
+            std::snprintf(buf, sizeof(buf), i ? " %02x" : "%02x", static_cast<unsigned char>(data[i]));
+            out += buf;
+          }
+          out += '}';
+        } else {
+          out += '"';
+          impl::appendEscaped(out, data);
+          out += tag == 'S' ? "\"..." : "\"";
+        }
+        break;
+      }
+      default: out += '?'; break;
+      }
+      if (!ok) break;
+    }
+    return out;
+  }
+
+} // namespace utils_log
@@ -0,0 +1,348 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bloom.hpp"
+#include "levels.hpp"
+#include "mapped_file.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTILS_LOG_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef UTILS_LOG_ZLIB
+#include <zlib.h>
+#endif
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                     searchLogs (output.log and its rotations)
+  // ============================================================================
+  // Segments are mapped (gzip ones inflated, one thread each) and cut into
+  // newline-aligned chunks searched by all threads. A chunk whose first and
+  // last records lie outside the time range is skipped whole; inside one the
+  // message text is searched first and only the records it hits are parsed
+  // for time, tid and level. Hits come back ordered by time, then segment
+  // order (oldest segment first), then file offset.
+  // A whole-word query skips segments whose Bloom sidecar (bloom.hpp) rules
+  // out one of its tokens.
+  struct SearchQuery {
+    std::string text;          // in the message; empty: every record
+    bool wholeWord = false;    // text not preceded or followed by a token character (bloom.hpp)
+    std::string from;          // "YYYY-MM-DD[ HH:MM:SS]", inclusive; empty: no bound
+    std::string to;            // exclusive; a prefix ("2026-10-18") ends after it
+    bool anyTid = true;
+    uint64_t tid = 0;
+    int minLevel = 0;          // Level
+    unsigned threads = 0;      // 0: hardware concurrency
+  };
+
+  struct SearchHit {
+    size_t segment;            // index into the segments searched
+    uint64_t offset;           // of the record in the (inflated) segment
+    std::string line;
+  };
+
+  struct SearchResult {
+    std::vector<SearchHit> hits;
+    std::vector<std::string> errors; // segments that could not be read
+    size_t skipped = 0;              // segments ruled out by their Bloom filter
+  };
+
+  // The rotations of an output.log that exist, oldest first by modification time:
+  // base.old, base.gz.old, base.gz, base.
+  inline std::vector<std::string> logSegments(const std::string &base) {
+    namespace fs = std::filesystem;
+    std::vector<std::pair<fs::file_time_type, std::string>> found;
+    for (const auto &name : { base + ".old", base + ".gz.old", base + ".gz", base }) {
+      std::error_code ec;
+      const auto t = fs::last_write_time(name, ec);
+      if (!ec) found.emplace_back(t, name);
+    }
+    std::stable_sort(found.begin(), found.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    std::vector<std::string> out;
+    for (auto &f : found) out.push_back(std::move(f.second));
+    return out;
+  }
+
+  namespace impl {
+
+    inline unsigned lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+      unsigned long i;
+      _BitScanForward(&i, mask);
+      return static_cast<unsigned>(i);
+#else
+      return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    // Candidates where the first and last needle bytes both match, 16 at a
+    // time, then a memcmp; memchr-speed on text without the first byte.
+    inline size_t findSubstring(std::string_view hay, std::string_view needle, size_t from = 0) {
+      const size_t n = needle.size();
+      if (n == 0) return from <= hay.size() ? from : std::string_view::npos;
+      if (hay.size() < n || from > hay.size() - n) return std::string_view::npos;
+      if (n == 1) {
+        const void *p = std::memchr(hay.data() + from, needle[0], hay.size() - from);
+        return p ? static_cast<size_t>(static_cast<const char *>(p) - hay.data()) : std::string_view::npos;
+      }
+      size_t i = from;
+#if defined(UTILS_LOG_SSE2)
+      const auto first = _mm_set1_epi8(needle[0]);
+      const auto last = _mm_set1_epi8(needle[n - 1]);
+      for (; i + n - 1 + 16 <= hay.size(); i += 16) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay.data() + i));
+        const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay.data() + i + n - 1));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        for (; mask; mask &= mask - 1) {
+          const size_t at = i + lowestBit(mask);
+          if (std::memcmp(hay.data() + at + 1, needle.data() + 1, n - 2) == 0) return at;
+        }
+      }
+#endif
+      const auto pos = hay.find(needle, i);
+      return pos;
+    }
+
+    // Fields of "[YYYY-MM-DD HH:MM:SS] tid=N[ seq=N] LEVEL \"msg\"..."
+    struct RecordFields {
+      std::string_view stamp;
+      uint64_t tid = 0;
+      int level = -1;
+      size_t msgBegin = 0;     // offset of the message in the line
+      size_t msgEnd = 0;
+    };
+
+    inline bool parseRecord(std::string_view line, RecordFields &f) {
+      if (line.size() < 22 || line[0] != '[' || line[20] != ']') return false;
+      f.stamp = line.substr(1, 19);
+      size_t i = 22;
+      if (line.compare(i, 4, "tid=") != 0) return false;
+      f.tid = 0;
+      for (i += 4; i < line.size() && line[i] >= '0' && line[i] <= '9'; ++i) f.tid = f.tid * 10 + static_cast<uint64_t>(line[i] - '0');
+      const auto quote = line.find('"', i);
+      const auto close = line.rfind('"');
+      if (quote == std::string_view::npos || close == quote || quote < 2) return false;
+      const auto sp = line.rfind(' ', quote - 2);
+      const auto name = line.substr(sp + 1, quote - sp - 2);
+      f.level = -1;
+      for (int l = 0; l < static_cast<int>(Level::Off); ++l) {
+        if (name == levelNames[l]) f.level = l;
+      }
+      f.msgBegin = quote + 1;
+      f.msgEnd = close;
+      return true;
+    }
+
+    // "2026-10-18 07:00" against the bound "2026-10-18": compared on the bound's length.
+    inline bool beforeFrom(std::string_view stamp, const std::string &from) {
+      return !from.empty() && stamp.compare(0, from.size(), from) < 0;
+    }
+
+    inline bool atOrAfterTo(std::string_view stamp, const std::string &to) {
+      return !to.empty() && stamp.compare(0, to.size(), to) >= 0;
+    }
+
+    inline bool containsText(const SearchQuery &q, std::string_view msg) {
+      for (size_t pos = findSubstring(msg, q.text); pos != std::string_view::npos; pos = findSubstring(msg, q.text, pos + 1)) {
+        if (!q.wholeWord) return true;
+        const size_t end = pos + q.text.size();
+        if ((pos == 0 || !isTokenChar(msg[pos - 1])) && (end == msg.size() || !isTokenChar(msg[end]))) return true;
+      }
+      return false;
+    }
+
+    inline bool matches(const SearchQuery &q, std::string_view line, RecordFields &f) {
+      if (!parseRecord(line, f)) return false;
+      if (beforeFrom(f.stamp, q.from) || atOrAfterTo(f.stamp, q.to)) return false;
+      if (!q.anyTid && f.tid != q.tid) return false;
+      if (f.level < q.minLevel) return false;
+      return q.text.empty() || containsText(q, line.substr(f.msgBegin, f.msgEnd - f.msgBegin));
+    }
+
+    // True if the segment's sidecar shows a token of a whole-word query is absent.
+    inline bool ruledOut(const SearchQuery &q, const std::string &segment) {
+      if (!q.wholeWord || q.text.empty()) return false;
+      std::error_code ec;
+      const auto size = std::filesystem::file_size(segment, ec);
+      if (ec) return false;
+      MappedFile sidecar(segment + ".bloom");
+      TokenBloom bloom;
+      if (!bloom.load(sidecar.view(), size)) return false;
+      bool absent = false;
+      // every token of the query is a whole token of a matching message
+      forEachToken(q.text, bloom.minToken(), [&](std::string_view t) { absent = absent || !bloom.mayContain(t); });
+      return absent;
+    }
+
+    struct SearchChunk {
+      size_t segment;
+      std::string_view data;   // whole lines
+      uint64_t offset;
+      std::vector<SearchHit> hits;
+    };
+
+    inline std::string_view lineAt(std::string_view data, size_t pos) {
+      const auto *nl = static_cast<const char *>(std::memchr(data.data() + pos, '\n', data.size() - pos));
+      const size_t end = nl ? static_cast<size_t>(nl - data.data()) : data.size();
+      auto line = data.substr(pos, end - pos);
+      if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+      return line;
+    }
+
+    inline size_t lineStart(std::string_view data, size_t pos) {
+      while (pos > 0 && data[pos - 1] != '\n') --pos;
+      return pos;
+    }
+
+    inline void searchChunk(const SearchQuery &q, SearchChunk &c) {
+      const auto data = c.data;
+      if (data.empty()) return;
+      if (!q.from.empty() || !q.to.empty()) {
+        RecordFields first, last;
+        const bool hasFirst = parseRecord(lineAt(data, 0), first);
+        const bool hasLast = parseRecord(lineAt(data, lineStart(data, data.size() - 1)), last);
+        if (hasFirst && hasLast && (atOrAfterTo(first.stamp, q.to) || beforeFrom(last.stamp, q.from))) return;
+      }
+
+      RecordFields f;
+      auto take = [&](size_t begin) {
+        const auto line = lineAt(data, begin);
+        if (matches(q, line, f)) c.hits.push_back(SearchHit{ c.segment, c.offset + begin, std::string(line) });
+        return begin + line.size() + 1;
+      };
+
+      if (q.text.empty()) {
+        for (size_t pos = 0; pos < data.size();) pos = take(pos);
+        return;
+      }
+      for (size_t pos = findSubstring(data, q.text); pos != std::string_view::npos;) {
+        const size_t next = take(lineStart(data, pos));
+        pos = next < data.size() ? findSubstring(data, q.text, next) : std::string_view::npos;
+      }
+    }
+
+#ifdef UTILS_LOG_ZLIB
+    // All members of a (multi-member) gzip file; a torn last member yields
+    // what it decodes to.
+    inline bool inflateGzip(std::string_view in, std::string &out) {
+      z_stream zs{};
+      if (inflateInit2(&zs, 15 + 32) != Z_OK) return false;
+      zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+      zs.avail_in = static_cast<uInt>(in.size());
+      char buf[1 << 16];
+      int rc = Z_OK;
+      while (zs.avail_in > 0 || rc == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef *>(buf);
+        zs.avail_out = sizeof(buf);
+        rc = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+        if (rc == Z_STREAM_END) {
+          if (zs.avail_in == 0) break;
+          inflateReset(&zs);
+          rc = Z_OK;
+        } else if (rc != Z_OK) {
+          break;
+        }
+      }
+      inflateEnd(&zs);
+      return rc == Z_STREAM_END || rc == Z_BUF_ERROR;
+    }
+#endif
+
+    template <typename F>
+    void parallelFor(size_t n, unsigned threads, F &&f) {
+      std::atomic<size_t> next{ 0 };
+      auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < n;) f(i);
+      };
+      std::vector<std::thread> pool;
+      for (unsigned t = 1; t < threads && t < n; ++t) pool.emplace_back(worker);
+      worker();
+      for (auto &t : pool) t.join();
+    }
+
+  } // namespace impl
+
+  inline SearchResult searchLogs(const std::vector<std::string> &segments, const SearchQuery &q, size_t chunkBytes = 4 << 20) {
+    SearchResult r;
+    unsigned threads = q.threads ? q.threads : std::thread::hardware_concurrency();
+    if (!threads) threads = 1;
+
+    struct Segment {
+      impl::MappedFile file;
+      std::string inflated;
+      std::string_view data;
+      std::string error;
+    };
+    std::vector<Segment> segs(segments.size());
+    std::atomic<size_t> skipped{ 0 };
+    impl::parallelFor(segments.size(), threads, [&](size_t i) {
+      auto &s = segs[i];
+      if (impl::ruledOut(q, segments[i])) {
+        skipped++;
+        return;
+      }
+      if (!s.file.open(segments[i])) {
+        s.error = "cannot open " + segments[i];
+        return;
+      }
+      const auto raw = s.file.view();
+      if (raw.size() >= 2 && static_cast<unsigned char>(raw[0]) == 0x1f && static_cast<unsigned char>(raw[1]) == 0x8b) {
+#ifdef UTILS_LOG_ZLIB
+        if (!impl::inflateGzip(raw, s.inflated)) s.error = segments[i] + ": damaged gzip data, searched up to it";
+        s.data = s.inflated;
+        s.file.close();
+#else
+        s.error = segments[i] + ": gzip segment skipped (build with -DUTILS_LOG_ZLIB -lz)";
+#endif
+      } else {
+        s.data = raw;
+      }
+    });
+
+    r.skipped = skipped;
+
+    std::vector<impl::SearchChunk> chunks;
+    for (size_t i = 0; i < segs.size(); ++i) {
+      if (!segs[i].error.empty()) r.errors.push_back(segs[i].error);
+      const auto data = segs[i].data;
+      for (size_t pos = 0; pos < data.size();) {
+        size_t end = std::min(data.size(), pos + chunkBytes);
+        if (end < data.size()) {
+          const auto *nl = static_cast<const char *>(std::memchr(data.data() + end, '\n', data.size() - end));
+          end = nl ? static_cast<size_t>(nl - data.data()) + 1 : data.size();
+        }
+        chunks.push_back(impl::SearchChunk{ i, data.substr(pos, end - pos), pos, {} });
+        pos = end;
+      }
+    }
+    impl::parallelFor(chunks.size(), threads, [&](size_t i) { impl::searchChunk(q, chunks[i]); });
+
+    for (auto &c : chunks) {
+      for (auto &h : c.hits) r.hits.push_back(std::move(h));
+    }
+    // chunks are already in segment and offset order
+    std::stable_sort(r.hits.begin(), r.hits.end(), [](const SearchHit &a, const SearchHit &b) {
+      return std::string_view(a.line).substr(1, 19) < std::string_view(b.line).substr(1, 19);
+    });
+    return r;
+  }
+
+} // namespace utils_log
@@ -0,0 +1,136 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#if defined(__has_include)
+#if __has_include(<execinfo.h>) && __has_include(<dlfcn.h>)
+#include <execinfo.h>
+#include <dlfcn.h>
+#define UTILS_LOG_BACKTRACE 1
+#if __has_include(<link.h>)
+#include <link.h>
+#endif
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#define UTILS_LOG_DEMANGLE 1
+#endif
+#endif
+#endif
+
+#if !defined(UTILS_LOG_BACKTRACE) && defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+
+namespace utils_log::impl {
+
+  // ============================================================================
+  //                                StackTrace
+  // ============================================================================
+  // Raw return addresses only; capture never symbolizes. moduleOffsets()
+  // turns them into "module+0xoffset" (cached per address), which addr2line
+  // or tools/log_symbolize.cpp resolve offline.
+  struct StackTrace {
+    static constexpr int maxFrames = 32;
+    void *frames[maxFrames];
+    int size = 0;
+
+    void capture(int skip) {
+#if defined(UTILS_LOG_BACKTRACE)
+      void *all[maxFrames + 8];
+      const int n = ::backtrace(all, maxFrames + 8);
+      size = 0;
+      for (int i = skip; i < n && size < maxFrames; ++i) frames[size++] = all[i];
+#elif defined(_WIN32)
+      size = static_cast<int>(::CaptureStackBackTrace(static_cast<DWORD>(skip), maxFrames, frames, nullptr));
+#else
+      (void)skip;
+      size = 0;
+#endif
+    }
+  };
+
+  // "module+0xoffset", or the absolute address for non-relocatable executables
+  // and when the module cannot be determined.
+  inline std::string moduleOffset(void *addr) {
+    char buf[32];
+#if defined(UTILS_LOG_BACKTRACE)
+    Dl_info info{};
+    if (::dladdr(addr, &info) && info.dli_fname && info.dli_fbase) {
+      auto off = reinterpret_cast<uintptr_t>(addr) - reinterpret_cast<uintptr_t>(info.dli_fbase);
+#if defined(ELFMAG) && defined(ET_EXEC)
+      if (static_cast<const ElfW(Ehdr) *>(info.dli_fbase)->e_type == ET_EXEC) off = reinterpret_cast<uintptr_t>(addr);
+#endif
+      std::snprintf(buf, sizeof(buf), "+0x%llx", static_cast<unsigned long long>(off));
+      return info.dli_fname + std::string(buf);
+    }
+#endif
+    std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(addr)));
+    return buf;
+  }
+
+  // Comma separated frames; a frame in the same module as the previous one
+  // is written as "+0xoffset" only.
+  inline std::string moduleOffsets(const StackTrace &st) {
+    static std::mutex m;
+    static std::unordered_map<void *, std::string> cache;
+    std::scoped_lock lock(m);
+    if (cache.size() > 8192) cache.clear();
+
+    std::string out, prevModule;
+    for (int i = 0; i < st.size; ++i) {
+      auto it = cache.find(st.frames[i]);
+      if (it == cache.end()) it = cache.emplace(st.frames[i], moduleOffset(st.frames[i])).first;
+      const std::string &frame = it->second;
+      const auto plus = frame.rfind('+');
+      const auto module = plus == std::string::npos ? std::string() : frame.substr(0, plus);
+      if (i) out += ',';
+      if (!module.empty() && module == prevModule) out.append(frame, plus, std::string::npos);
+      else out += frame;
+      prevModule = module;
+    }
+    return out;
+  }
+
+  // In-process symbolization ("function+0xoff (module)") for callers that can
+  // afford it, e.g. crash reports. Cached per address.
+  inline std::string symbolize(void *addr) {
+    static std::mutex m;
+    static std::unordered_map<void *, std::string> cache;
+    std::scoped_lock lock(m);
+    if (auto it = cache.find(addr); it != cache.end()) return it->second;
+
+    std::string out;
+#if defined(UTILS_LOG_BACKTRACE)
+    Dl_info info{};
+    if (::dladdr(addr, &info) && info.dli_sname) {
+      out = info.dli_sname;
+#if defined(UTILS_LOG_DEMANGLE)
+      int status = 0;
+      if (char *dem = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status)) {
+        if (status == 0) out = dem;
+        std::free(dem);
+      }
+#endif
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "+0x%llx",
+        static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(addr) - reinterpret_cast<uintptr_t>(info.dli_saddr)));
+      out += buf;
+      if (info.dli_fname) out += std::string(" (") + info.dli_fname + ")";
+    }
+#endif
+    if (out.empty()) out = moduleOffset(addr);
+    if (cache.size() > 8192) cache.clear();
+    cache.emplace(addr, out);
+    return out;
+  }
+
+} // namespace utils_log::impl
@@ -0,0 +1,134 @@
+// Author: Arman Sahakyan
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "crc32c.hpp"
+
+
+namespace utils_log {
+
+  // ============================================================================
+  //                         verifyLog (output.log checker)
+  // ============================================================================
+  // Scans an output.log written with SET_LOG_SEQUENCE / SET_LOG_CHECKSUM and
+  // reports sequence gaps, checksum mismatches and a torn last record.
+  // A sequence number of 1 marks the start of a new process run.
+  struct VerifyReport {
+    uint64_t records = 0;
+    uint64_t checked = 0;      // records carrying a crc
+    uint64_t corrupted = 0;    // crc mismatch or malformed crc field
+    uint64_t gaps = 0;         // number of sequence discontinuities
+    uint64_t missing = 0;      // total sequence numbers skipped
+    uint64_t reordered = 0;    // sequence went backwards without restarting
+    bool tornTail = false;     // last record not newline terminated
+    std::vector<std::string> issues; // first maxIssues findings, "line N: ..."
+
+    bool ok() const { return corrupted == 0 && gaps == 0 && reordered == 0 && !tornTail; }
+  };
+
+  namespace impl {
+    inline bool parseHex32(std::string_view s, uint32_t &out) {
+      if (s.size() != 8) return false;
+      out = 0;
+      for (char c : s) {
+        out <<= 4;
+        if (c >= '0' && c <= '9') out |= uint32_t(c - '0');
+        else if (c >= 'a' && c <= 'f') out |= uint32_t(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') out |= uint32_t(c - 'A' + 10);
+        else return false;
+      }
+      return true;
+    }
+
+    // Parses the decimal number following `key` in `line`, e.g. key = " seq=".
+    inline bool parseField(std::string_view line, std::string_view key, uint64_t &out) {
+      const auto pos = line.find(key);
+      if (pos == std::string_view::npos) return false;
+      size_t i = pos + key.size();
+      if (i >= line.size() || line[i] < '0' || line[i] > '9') return false;
+      out = 0;
+      for (; i < line.size() && line[i] >= '0' && line[i] <= '9'; ++i)
+        out = out * 10 + uint64_t(line[i] - '0');
+      return true;
+    }
+  }
+
+  inline VerifyReport verifyLog(const std::string &fname, size_t maxIssues = 100) {
+    VerifyReport r;
+    std::ifstream ifs(fname, std::ios::binary);
+    if (!ifs.is_open()) {
+      r.issues.push_back("cannot open " + fname);
+      return r;
+    }
+
+    auto issue = [&](uint64_t lineNo, const std::string &what) {
+      if (r.issues.size() < maxIssues) r.issues.push_back("line " + std::to_string(lineNo) + ": " + what);
+    };
+
+    uint64_t globalPrev = 0;
+    std::unordered_map<uint64_t, uint64_t> threadPrev;
+    uint64_t corruptedSinceGood = 0; // already reported, not counted again as missing
+
+    auto checkSeq = [&](uint64_t lineNo, uint64_t seq, uint64_t &prev) {
+      if (seq == 1 || prev == 0) {
+        // new run (or first record seen)
+      } else if (seq > prev + 1) {
+        const auto skipped = seq - prev - 1;
+        const auto lost = skipped - std::min(skipped, corruptedSinceGood);
+        if (lost) {
+          ++r.gaps;
+          r.missing += lost;
+          issue(lineNo, "gap, " + std::to_string(lost) + " record(s) missing after seq " + std::to_string(prev));
+        }
+      } else if (seq <= prev) {
+        ++r.reordered;
+        issue(lineNo, "seq " + std::to_string(seq) + " after " + std::to_string(prev));
+      }
+      prev = seq;
+    };
+
+    std::string line;
+    uint64_t lineNo = 0;
+    while (std::getline(ifs, line)) {
+      ++lineNo;
+      if (ifs.eof()) {
+        r.tornTail = true;
+        issue(lineNo, "last record is not newline terminated (torn write)");
+      }
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (line.empty()) continue;
+      ++r.records;
+      const std::string_view sv(line);
+
+      const auto crcPos = sv.rfind(" crc=");
+      if (crcPos != std::string_view::npos && crcPos + 5 + 8 == sv.size()) {
+        ++r.checked;
+        uint32_t stored = 0;
+        if (!impl::parseHex32(sv.substr(crcPos + 5), stored) || stored != impl::crc32c(sv.data(), crcPos)) {
+          ++r.corrupted;
+          ++corruptedSinceGood;
+          issue(lineNo, "checksum mismatch");
+          continue; // fields of a corrupted record are not trusted
+        }
+      }
+
+      // "[date] tid=N seq=K LEVEL \"msg..." : fields only from before the message
+      const auto header = sv.substr(0, sv.find('"'));
+      uint64_t seq = 0, tid = 0;
+      if (impl::parseField(header, " seq=", seq)) {
+        checkSeq(lineNo, seq, globalPrev);
+      } else if (impl::parseField(header, " tseq=", seq) && impl::parseField(header, "] tid=", tid)) {
+        checkSeq(lineNo, seq, threadPrev[tid]);
+      }
+      corruptedSinceGood = 0;
+    }
+    return r;
+  }
+
+} // namespace utils_log